@@ -0,0 +1,38 @@
+import threading
+import time
+from collections import OrderedDict
+
+class ActivityLog:
+    # Per-device, per-hour counts of windows uploaded and windows the device suppressed as silent,
+    # as reported by its heartbeats. Keeps the most recent max_hours hours of each device.
+    def __init__(self, max_hours: int = 48):
+        self._max_hours = max_hours
+        self._devices = {}
+        self._lock = threading.Lock()
+
+    @staticmethod
+    def _hour(capture_start_us: int) -> int:
+        # Devices without a synced clock send 0; count those at the time of arrival.
+        seconds = capture_start_us / 1e6 if capture_start_us else time.time()
+        return int(seconds // 3600)
+
+    def record(self, device: str, capture_start_us: int, uploaded: int = 0, suppressed: int = 0):
+        hour = self._hour(capture_start_us)
+        with self._lock:
+            hours = self._devices.setdefault(device, OrderedDict())
+            counts = hours.setdefault(hour, {"uploaded": 0, "suppressed": 0})
+            counts["uploaded"] += uploaded
+            counts["suppressed"] += suppressed
+            while len(hours) > self._max_hours:
+                hours.popitem(last=False)
+
+    def snapshot(self):
+        # {device: {"YYYY-MM-DDTHH:00Z": {"uploaded": n, "suppressed": m}}}
+        with self._lock:
+            return {
+                device: {
+                    time.strftime("%Y-%m-%dT%H:00Z", time.gmtime(hour * 3600)): dict(counts)
+                    for hour, counts in sorted(hours.items())
+                }
+                for device, hours in self._devices.items()
+            }
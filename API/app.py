@@ -1,8 +1,61 @@
-from flask import Flask, jsonify, request
-from birdnet import analyze_recording
+import os
+
+import numpy as np
+from flask import Flask, g, jsonify, request
+from audio_codecs import SUPPORTED_ENCODINGS, decode_audio
+from birdnet import SAMPLE_RATE, analyze_recording, scheduler
+from activity_log import ActivityLog
+from capture_settings import CaptureSettings
+from clip_header import RecentClips, parse_clip, parse_heartbeat
+from ingest_queue import IngestQueue
+from log_mel import decode_log_mel, summarize_features
+from stitching import DetectionStitcher
 
 app = Flask(__name__)
 
+def process_upload(blob, encoding: str, sample_rate: int, gain_log2: int, header=None):
+    print(f"Detecting...")
+    detections = analyze_recording(decode_audio(blob, encoding), sample_rate, gain_log2)
+    # Overlapping windows hear the same call twice; only its first detection is reported.
+    detections = stitcher.stitch(header, detections)
+    print(f"Detections: {detections}")
+    return detections
+
+# Inference runs off the request thread so the device's connection is released as soon as the
+# body is queued. Workers mostly wait on the analyzer, so with INFERENCE_BATCHED=1 there are enough
+# of them for several devices' uploads to share a batch.
+ingest = IngestQueue(
+    process_upload,
+    workers=int(os.environ.get("INGEST_WORKERS", 8)),
+    max_depth=int(os.environ.get("INGEST_QUEUE_DEPTH", 32)),
+)
+recent_clips = RecentClips()
+stitcher = DetectionStitcher()
+activity = ActivityLog()
+# Window lengths etc. sent back to each device with its upload responses; see capture_settings.py.
+capture_settings = CaptureSettings(os.environ.get("CAPTURE_SETTINGS"))
+# Decoded features are kept as .npy files when set; the API has no model that runs on them.
+features_dir = os.environ.get("FEATURES_DIR")
+
+def record_heartbeat(header, payload):
+    # Devices post heartbeats to whichever route their clips go to, so /upload and /features both
+    # accept them.
+    try:
+        windows_suppressed, samples_suppressed = parse_heartbeat(payload)
+    except ValueError as error:
+        return jsonify({"error": str(error)}), 400
+    # A heartbeat resent after a lost response must not be counted twice.
+    if not recent_clips.contains(header):
+        recent_clips.add(header)
+        activity.record(header.device_mac, header.capture_start_us, suppressed=windows_suppressed)
+    return jsonify(
+        {
+            "message": "Heartbeat received",
+            "windows_suppressed": windows_suppressed,
+            "samples_suppressed": samples_suppressed,
+        }
+    ), 200
+
 @app.post("/upload")
 def upload_binary_blob():
     blob = request.get_data(cache=False, as_text=False)
@@ -10,17 +63,118 @@ def upload_binary_blob():
     if not blob:
         return jsonify({"error": "No binary data received"}), 400    
 
-    print(f"Detecting...")
-    detections = analyze_recording(blob)
-    print(f"Detections: {detections}")
+    try:
+        header, payload = parse_clip(blob)
+    except ValueError as error:
+        return jsonify({"error": str(error)}), 400
+    if header is not None:
+        g.device_mac = header.device_mac
+
+    if header is not None and header.heartbeat:
+        return record_heartbeat(header, payload)
+
+    # Headerless uploads from older firmware describe themselves in request headers.
+    if header is not None and header.encoding == "log-mel":
+        return jsonify({"error": "Log-mel features go to /features"}), 415
+    if header is not None:
+        encoding = header.encoding
+        sample_rate = header.sample_rate
+        gain_log2 = header.gain_log2
+    else:
+        gain_log2 = 0
+        encoding = request.headers.get("X-Audio-Encoding", "pcm16")
+        sample_rate = request.headers.get("X-Sample-Rate", SAMPLE_RATE, type=int)
+        if encoding not in SUPPORTED_ENCODINGS:
+            return jsonify({"error": f"Unsupported audio encoding: {encoding}"}), 415
+
+    # Duplicates and silent clips are acknowledged without inference so the device moves on.
+    if header is not None and recent_clips.contains(header):
+        return jsonify({"message": "Duplicate clip ignored", "clip": header.as_dict()}), 200
+    if header is not None and header.complete and header.non_zero_samples == 0:
+        return jsonify({"message": "Silent clip skipped", "clip": header.as_dict()}), 200
+
+    job_id = ingest.submit(payload, encoding, sample_rate, gain_log2, header, metadata=header.as_dict() if header else None)
+    if job_id is None:
+        # The device backs off for at least Retry-After and keeps the clip in its spool.
+        response = jsonify({"error": "Ingest queue full"})
+        response.headers["Retry-After"] = str(ingest.retry_after_seconds())
+        return response, 503
+    if header is not None:
+        recent_clips.add(header)
+        activity.record(header.device_mac, header.capture_start_us, uploaded=1)
 
     return jsonify(
         {
-            "message": "Binary blob received",
+            "message": "Binary blob queued",
+            "job_id": job_id,
             "bytes_received": len(blob),
             "content_type": request.content_type,
+            "encoding": encoding,
+            "clip": header.as_dict() if header else None,
+            "queue_depth": ingest.depth(),
+        }
+    ), 202
+
+@app.post("/features")
+def upload_features():
+    # Log-mel spectrograms from sites that cannot upload audio. Decoding and summarising them is
+    # cheap, so they are handled on the request thread.
+    try:
+        header, payload = parse_clip(request.get_data(cache=False, as_text=False))
+    except ValueError as error:
+        return jsonify({"error": str(error)}), 400
+    if header is not None and header.heartbeat:
+        g.device_mac = header.device_mac
+        return record_heartbeat(header, payload)
+    if header is None or header.encoding != "log-mel":
+        return jsonify({"error": "Expected a log-mel clip"}), 415
+    g.device_mac = header.device_mac
+    if recent_clips.contains(header):
+        return jsonify({"message": "Duplicate clip ignored", "clip": header.as_dict()}), 200
+
+    try:
+        fmt, features = decode_log_mel(payload, header.gain_log2)
+    except ValueError as error:
+        return jsonify({"error": str(error)}), 400
+    if features_dir:
+        os.makedirs(features_dir, exist_ok=True)
+        name = f"{header.device_mac.replace(':', '')}_{header.capture_start_us}_{header.sequence}.npy"
+        np.save(os.path.join(features_dir, name), features)
+    recent_clips.add(header)
+    activity.record(header.device_mac, header.capture_start_us, uploaded=1)
+
+    return jsonify(
+        {
+            "message": "Features received",
+            "features": summarize_features(fmt, features, header.sample_rate),
+            "clip": header.as_dict(),
         }
     ), 200
 
+@app.after_request
+def send_capture_settings(response):
+    # Only devices that identified themselves with a clip header can be told their settings.
+    device_mac = g.get("device_mac")
+    if device_mac:
+        response.headers.update(capture_settings.headers(device_mac))
+    return response
+
+@app.get("/jobs/<job_id>")
+def get_job(job_id: str):
+    job = ingest.job(job_id)
+    if job is None:
+        return jsonify({"error": "Unknown job"}), 404
+    return jsonify(job), 200
+
+@app.get("/activity")
+def get_activity():
+    return jsonify(activity.snapshot()), 200
+
+@app.get("/metrics")
+def get_metrics():
+    metrics = ingest.metrics()
+    metrics["inference_batches"] = scheduler.metrics() if scheduler is not None else None
+    return jsonify(metrics), 200
+
 if __name__ == "__main__":
     app.run(host="0.0.0.0", port=5000, debug=True, use_reloader=True, reloader_type="stat")
@@ -0,0 +1,122 @@
+import array
+import io
+
+import soundfile
+
+# IMA/DVI ADPCM tables, matching ESP_Code/main/adpcm_encoder.cpp.
+IMA_STEP_TABLE = [
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31,
+    34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143,
+    157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658,
+    724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024,
+    3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767,
+]
+IMA_INDEX_TABLE = [-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8]
+
+def decode_ima_adpcm(data: bytes) -> bytes:
+    # Two samples per byte, low nibble first; the device resets predictor and step to 0 per upload.
+    predictor = 0
+    step_index = 0
+    samples = array.array("h", bytes(len(data) * 4))
+    position = 0
+    for byte in data:
+        for nibble in (byte & 0x0F, byte >> 4):
+            step = IMA_STEP_TABLE[step_index]
+            delta = step >> 3
+            if nibble & 4:
+                delta += step
+            if nibble & 2:
+                delta += step >> 1
+            if nibble & 1:
+                delta += step >> 2
+            predictor = predictor - delta if nibble & 8 else predictor + delta
+            predictor = max(-32768, min(32767, predictor))
+            step_index = max(0, min(88, step_index + IMA_INDEX_TABLE[nibble]))
+            samples[position] = predictor
+            position += 1
+    return samples.tobytes()
+
+FLAC_STREAMINFO_TOTAL_OFFSET = 21
+
+def _flac_block_size(code: int, header: bytes, position: int):
+    # Returns the block size and how many extra header bytes it used.
+    if code == 1:
+        return 192, 0
+    if 2 <= code <= 5:
+        return 576 << (code - 2), 0
+    if code == 6:
+        return header[position] + 1, 1
+    if code == 7:
+        return int.from_bytes(header[position:position + 2], "big") + 1, 2
+    if code >= 8:
+        return 256 << (code - 8), 0
+    raise ValueError("Reserved FLAC block size code")
+
+def _flac_crc8(data: bytes) -> int:
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+def _flac_last_frame_end(blob: bytes):
+    # Scans back for the last frame header with a valid CRC-8 and returns frame number * block
+    # size + its block size, i.e. the stream's sample count for a fixed-block-size stream.
+    min_block_size = int.from_bytes(blob[8:10], "big")
+    position = blob.rfind(b"\xff\xf8")
+    while position >= 42:
+        try:
+            header = blob[position:position + 16]
+            # Frame number is UTF-8 coded: the count of leading one bits is the byte count.
+            length = 8 - (header[4] ^ 0xFF).bit_length() if header[4] >= 0x80 else 1
+            frame_number = header[4] & (0xFF >> (length + 1)) if length > 1 else header[4]
+            for extra in header[5:4 + length]:
+                frame_number = (frame_number << 6) | (extra & 0x3F)
+            cursor = 4 + length
+            block_size, used = _flac_block_size(header[2] >> 4, header, cursor)
+            cursor += used
+            rate_code = header[2] & 0x0F
+            cursor += 1 if rate_code == 0xC else 2 if rate_code in (0xD, 0xE) else 0
+            if _flac_crc8(header[:cursor]) == header[cursor]:
+                return frame_number * min_block_size + block_size
+        except (IndexError, ValueError):
+            pass
+        position = blob.rfind(b"\xff\xf8", 0, position)
+    return 0
+
+def decode_flac(blob: bytes) -> bytes:
+    # Streamed uploads do not know their length up front and leave the STREAMINFO sample count at
+    # 0, which libsndfile cannot read; fill it in from the last frame before decoding. The frame
+    # scan needs bytes rather than a view.
+    blob = bytes(blob)
+    if len(blob) < 42 or blob[:4] != b"fLaC":
+        raise ValueError("Not a FLAC stream")
+    total = blob[FLAC_STREAMINFO_TOTAL_OFFSET] & 0x0F
+    for byte in blob[FLAC_STREAMINFO_TOTAL_OFFSET + 1:FLAC_STREAMINFO_TOTAL_OFFSET + 5]:
+        total = (total << 8) | byte
+    if total == 0:
+        total = _flac_last_frame_end(blob)
+        patched = bytearray(blob)
+        patched[FLAC_STREAMINFO_TOTAL_OFFSET] = (patched[FLAC_STREAMINFO_TOTAL_OFFSET] & 0xF0) | (total >> 32)
+        patched[FLAC_STREAMINFO_TOTAL_OFFSET + 1:FLAC_STREAMINFO_TOTAL_OFFSET + 5] = (total & 0xFFFFFFFF).to_bytes(4, "big")
+        blob = bytes(patched)
+    samples, _ = soundfile.read(io.BytesIO(blob), dtype="int16")
+    return samples.astype("<i2").tobytes()
+
+SUPPORTED_ENCODINGS = ("", "pcm16", "ima-adpcm", "flac")
+
+def decode_audio(blob, encoding: str):
+    # Returns PCM16LE for any encoding the firmware can upload. blob may be a memoryview, and
+    # PCM16 comes back as the same view.
+    if encoding in ("", "pcm16"):
+        return blob
+    if encoding == "ima-adpcm":
+        return decode_ima_adpcm(blob)
+    if encoding == "flac":
+        try:
+            return decode_flac(blob)
+        except soundfile.LibsndfileError as error:
+            raise ValueError(f"Invalid FLAC upload: {error}") from error
+    raise ValueError(f"Unsupported audio encoding: {encoding}")
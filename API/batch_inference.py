@@ -0,0 +1,130 @@
+import queue
+import threading
+import time
+from concurrent.futures import Future
+
+import librosa
+import numpy as np
+
+MODEL_SAMPLE_RATE = 48000
+SEGMENT_SAMPLES = 3 * MODEL_SAMPLE_RATE
+# A trailing segment shorter than this is dropped rather than padded, as birdnetlib does.
+MIN_SEGMENT_SAMPLES = SEGMENT_SAMPLES // 2
+
+def split_segments(samples: np.ndarray, sample_rate: int):
+    # Resamples to the model rate and cuts the signal into the model's 3 second input windows,
+    # zero padding the last one.
+    if len(samples) * MODEL_SAMPLE_RATE < MIN_SEGMENT_SAMPLES * sample_rate:
+        return []
+    if sample_rate != MODEL_SAMPLE_RATE:
+        samples = librosa.resample(samples, orig_sr=sample_rate, target_sr=MODEL_SAMPLE_RATE, res_type="kaiser_fast")
+    segments = []
+    for start in range(0, len(samples), SEGMENT_SAMPLES):
+        segment = samples[start:start + SEGMENT_SAMPLES]
+        if len(segment) < MIN_SEGMENT_SAMPLES:
+            break
+        if len(segment) < SEGMENT_SAMPLES:
+            segment = np.pad(segment, (0, SEGMENT_SAMPLES - len(segment)))
+        segments.append(segment.astype(np.float32, copy=False))
+    return segments
+
+class _PendingUpload:
+    def __init__(self, segment_count: int):
+        self.future = Future()
+        self.scores = [None] * segment_count
+        self.remaining = segment_count
+
+class BatchScheduler:
+    # Micro-batches model invocations across uploads. predict() queues an upload's segments and
+    # blocks; a single thread owns the TFLite interpreter and runs whatever segments are pending,
+    # from any number of uploads, as one batch once max_batch segments are queued or max_wait
+    # seconds have passed since the first. Scores are then routed back to the upload they came from.
+    def __init__(self, analyzer, max_batch: int = 32, max_wait: float = 0.05):
+        self._interpreter = analyzer.interpreter
+        self._input_index = analyzer.input_layer_index
+        self._output_index = analyzer.output_layer_index
+        self._max_batch = max_batch
+        self._max_wait = max_wait
+        self._queue = queue.Queue()
+        self._lock = threading.Lock()
+        self._thread = None
+        self._batch_shape = None
+        self._batches = 0
+        self._segments = 0
+        self._last_batch_size = 0
+        self._last_invoke_seconds = 0.0
+        self._invoke_seconds = 0.0
+
+    def predict(self, segments) -> np.ndarray:
+        # Returns raw model outputs, one row per segment.
+        if not segments:
+            return np.zeros((0, 0), dtype=np.float32)
+        with self._lock:
+            if self._thread is None:
+                self._thread = threading.Thread(target=self._run, name="inference-batcher", daemon=True)
+                self._thread.start()
+        pending = _PendingUpload(len(segments))
+        for index, segment in enumerate(segments):
+            self._queue.put((pending, index, segment))
+        return pending.future.result()
+
+    def metrics(self):
+        with self._lock:
+            return {
+                "batches": self._batches,
+                "segments": self._segments,
+                "mean_batch_size": self._segments / self._batches if self._batches else 0.0,
+                "last_batch_size": self._last_batch_size,
+                "last_invoke_seconds": self._last_invoke_seconds,
+                "mean_invoke_seconds": self._invoke_seconds / self._batches if self._batches else 0.0,
+                "pending_segments": self._queue.qsize(),
+            }
+
+    def _run(self):
+        while True:
+            batch = [self._queue.get()]
+            deadline = time.monotonic() + self._max_wait
+            while len(batch) < self._max_batch:
+                remaining = deadline - time.monotonic()
+                if remaining <= 0:
+                    break
+                try:
+                    batch.append(self._queue.get(timeout=remaining))
+                except queue.Empty:
+                    break
+            self._invoke(batch)
+
+    def _invoke(self, batch):
+        started_at = time.monotonic()
+        try:
+            data = np.stack([segment for _, _, segment in batch])
+            # Reallocating tensors is only needed when the batch size changes.
+            if self._batch_shape != data.shape:
+                self._interpreter.resize_tensor_input(self._input_index, list(data.shape))
+                self._interpreter.allocate_tensors()
+                self._batch_shape = data.shape
+            self._interpreter.set_tensor(self._input_index, data)
+            self._interpreter.invoke()
+            outputs = self._interpreter.get_tensor(self._output_index)
+        except Exception as exception:
+            self._batch_shape = None
+            for pending in {id(pending): pending for pending, _, _ in batch}.values():
+                if not pending.future.done():
+                    pending.future.set_exception(exception)
+            return
+        elapsed = time.monotonic() - started_at
+
+        with self._lock:
+            self._batches += 1
+            self._segments += len(batch)
+            self._last_batch_size = len(batch)
+            self._last_invoke_seconds = elapsed
+            self._invoke_seconds += elapsed
+
+        for row, (pending, index, _) in enumerate(batch):
+            if pending.future.done():
+                continue
+            pending.scores[index] = outputs[row].copy()
+            pending.remaining -= 1
+            if pending.remaining == 0:
+                pending.future.set_result(np.stack(pending.scores))
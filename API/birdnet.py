@@ -1,39 +1,101 @@
-from birdnetlib import Recording
+from birdnetlib import RecordingBuffer
 from birdnetlib.analyzer import Analyzer
 from datetime import datetime
-import tempfile
+import math
 import os
-import wave
+import threading
+import numpy as np
+
+from batch_inference import SEGMENT_SAMPLES, MODEL_SAMPLE_RATE, BatchScheduler, split_segments
 
 # Load and initialize the BirdNET-Analyzer models.
 analyzer = Analyzer()
+# The analyzer's TFLite interpreter is not thread-safe, so ingest workers take turns running it.
+analyzer_lock = threading.Lock()
+# With INFERENCE_BATCHED=1, inference bypasses birdnetlib's Recording and drives the analyzer's
+# interpreter directly, through attributes that are not part of its public API. They are those of
+# the birdnetlib pinned in requirements.txt. Until compare_birdnetlib.py shows the two agree, each
+# upload goes through birdnetlib by default.
+BATCHED_INFERENCE = os.environ.get("INFERENCE_BATCHED") == "1"
+scheduler = None
+if BATCHED_INFERENCE:
+    _ANALYZER_ATTRIBUTES = ("interpreter", "input_layer_index", "output_layer_index", "labels", "return_predicted_species_list")
+    _missing = [name for name in _ANALYZER_ATTRIBUTES if not hasattr(analyzer, name)]
+    if _missing:
+        raise RuntimeError(f"Unsupported birdnetlib version, Analyzer lacks {', '.join(_missing)}")
+    # Every upload's segments go through one batching thread, the only user of the TFLite interpreter.
+    scheduler = BatchScheduler(
+        analyzer,
+        max_batch=int(os.environ.get("INFERENCE_MAX_BATCH", 32)),
+        max_wait=float(os.environ.get("INFERENCE_MAX_WAIT_MS", 50)) / 1000.0,
+    )
 
 SAMPLE_RATE = 8000
-CHANNELS = 1
-SAMPLE_WIDTH_BYTES = 2
-
-def analyze_recording(binary_audio: bytes):
-    # Parse raw PCM16LE audio into a valid .wav file and save it to a temporary file.
-    with tempfile.NamedTemporaryFile(suffix=".wav", delete=False) as temp_audio_file:
-        with wave.open(temp_audio_file, "wb") as wav_file:
-            wav_file.setnchannels(CHANNELS)
-            wav_file.setsampwidth(SAMPLE_WIDTH_BYTES)
-            wav_file.setframerate(SAMPLE_RATE)
-            wav_file.writeframes(binary_audio)
-        temp_audio_file.flush()
-    
-        recording = Recording(
-            analyzer,
-            temp_audio_file.name,
-            lat=35.4244,
-            lon=-120.7463,
-            date=datetime(year=2022, month=5, day=10), # use date or week_48
-            min_conf=0.25,
-        )
+PCM16_SCALE = np.float32(1.0 / 32768.0)
+LATITUDE = 35.4244
+LONGITUDE = -120.7463
+DATE = datetime(year=2022, month=5, day=10)
+MIN_CONFIDENCE = 0.25
+
+def _week_48(date: datetime) -> int:
+    # BirdNET's 48-week year, four weeks per month.
+    return min(48, max(1, math.ceil(date.timetuple().tm_yday / 7.5)))
+
+# Species plausible at the recorder's location and season, from BirdNET's metadata model; birdnetlib
+# applies the same filter itself.
+species_list = set()
+if BATCHED_INFERENCE:
+    species_list = set(analyzer.return_predicted_species_list(lat=LATITUDE, lon=LONGITUDE, week_48=_week_48(DATE)))
+
+def pcm16_to_float(binary_audio: bytes, gain_log2: int = 0) -> np.ndarray:
+    # Views the PCM16LE bytes in place and scales them to [-1, 1) in a single float32 allocation,
+    # undoing the device's adaptive gain so every clip is at the mic's true level. A trailing odd
+    # byte is ignored.
+    samples = np.frombuffer(binary_audio, dtype="<i2", count=len(binary_audio) // 2)
+    return samples * np.float32(PCM16_SCALE / (1 << gain_log2))
 
+def analyze_recording(binary_audio: bytes, sample_rate: int = SAMPLE_RATE, gain_log2: int = 0):
+    if BATCHED_INFERENCE:
+        return analyze_batched(binary_audio, sample_rate, gain_log2)
+    # Analyzes the samples in memory; birdnetlib resamples the buffer to the model rate itself.
+    recording = RecordingBuffer(
+        analyzer,
+        pcm16_to_float(binary_audio, gain_log2),
+        sample_rate,
+        lat=LATITUDE,
+        lon=LONGITUDE,
+        date=DATE,
+        min_conf=MIN_CONFIDENCE,
+    )
+
+    with analyzer_lock:
         recording.analyze()
-    
-    # Clean up the temporary file
-    os.remove(temp_audio_file.name)
 
-    return recording.detections
\ No newline at end of file
+    return recording.detections
+
+def analyze_batched(binary_audio: bytes, sample_rate: int = SAMPLE_RATE, gain_log2: int = 0):
+    # birdnetlib's resampling, segmenting and scoring, with the model run by the batch scheduler.
+    segments = split_segments(pcm16_to_float(binary_audio, gain_log2), sample_rate)
+    logits = scheduler.predict(segments)
+    # Same sigmoid birdnetlib applies at the default sensitivity of 1.
+    confidences = 1.0 / (1.0 + np.exp(-np.clip(logits, -15, 15)))
+
+    detections = []
+    segment_seconds = SEGMENT_SAMPLES / MODEL_SAMPLE_RATE
+    for segment, scores in enumerate(confidences):
+        for label_index in np.flatnonzero(scores >= MIN_CONFIDENCE):
+            label = analyzer.labels[label_index]
+            if species_list and label not in species_list:
+                continue
+            scientific_name, _, common_name = label.partition("_")
+            detections.append(
+                {
+                    "common_name": common_name,
+                    "scientific_name": scientific_name,
+                    "start_time": segment * segment_seconds,
+                    "end_time": (segment + 1) * segment_seconds,
+                    "confidence": float(scores[label_index]),
+                    "label": label,
+                }
+            )
+    return detections
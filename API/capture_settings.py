@@ -0,0 +1,39 @@
+import json
+import os
+import threading
+
+# Response headers that retune a device's capture, mirrored by the HttpUploader response parsing.
+SETTING_HEADERS = {"window_ms": "X-Window-Ms", "hop_ms": "X-Hop-Ms"}
+
+class CaptureSettings:
+    # Per-site capture settings handed to devices in upload responses. The file is JSON mapping a
+    # device MAC (or "default") to settings, e.g. {"default": {"window_ms": 5000},
+    # "aa:bb:cc:dd:ee:ff": {"window_ms": 9000, "hop_ms": 6000}}. It is re-read when it changes, so windows can be
+    # retuned without restarting the API or reflashing devices.
+    def __init__(self, path):
+        self._path = path
+        self._mtime = None
+        self._settings = {}
+        self._lock = threading.Lock()
+
+    def _load(self):
+        try:
+            mtime = os.path.getmtime(self._path)
+        except OSError:
+            return {}
+        with self._lock:
+            if mtime != self._mtime:
+                try:
+                    with open(self._path) as f:
+                        self._settings = json.load(f)
+                except (OSError, ValueError) as error:
+                    print(f"Ignoring capture settings in {self._path}: {error}")
+                self._mtime = mtime
+            return self._settings
+
+    def headers(self, device_mac: str):
+        if not self._path:
+            return {}
+        settings = self._load()
+        merged = {**settings.get("default", {}), **settings.get(device_mac, {})}
+        return {SETTING_HEADERS[key]: str(int(value)) for key, value in merged.items() if key in SETTING_HEADERS}
@@ -0,0 +1,123 @@
+import struct
+import threading
+from collections import OrderedDict
+from typing import NamedTuple, Optional
+
+# Mirrors ClipHeader in ESP_Code/main/clip_header.h: little-endian, fields only appended. Headers
+# from older firmware end after gain_log2 or the window fields and lack what follows.
+CLIP_HEADER = struct.Struct("<4sBBH6sHqIIIhhIB3x")
+CLIP_HEADER_WINDOW = struct.Struct("<II")
+CLIP_HEADER_STREAM = struct.Struct("<QII")
+CLIP_HEADER_MAGIC = b"BSCL"
+CLIP_FLAG_COMPLETE = 1 << 0
+CLIP_FLAG_HEARTBEAT = 1 << 1
+# The clip is the active span of a longer window, starting window_offset samples into it.
+CLIP_FLAG_TRIMMED = 1 << 2
+# Body of a heartbeat clip: windows and samples the device held back as silent since the last one.
+CLIP_HEARTBEAT = struct.Struct("<II")
+# Body of a log-mel clip, ahead of its frames; mirrors ClipLogMel.
+CLIP_LOG_MEL = struct.Struct("<HHHHBxhH")
+CLIP_CODEC_ENCODINGS = {0: "pcm16", 1: "ima-adpcm", 2: "flac", 3: "log-mel"}
+
+class ClipHeader(NamedTuple):
+    version: int
+    encoding: str
+    device_mac: str
+    complete: bool
+    heartbeat: bool
+    capture_start_us: int
+    sample_rate: int
+    sample_count: int
+    sequence: int
+    min_sample: int
+    max_sample: int
+    non_zero_samples: int
+    gain_log2: int
+    trimmed: bool = False
+    window_offset: int = 0
+    window_sample_count: int = 0
+    # Position of the clip's first sample since the device booted; stream_id changes every boot.
+    first_sample: int = 0
+    stream_id: int = 0
+    hop_samples: int = 0
+
+    def as_dict(self):
+        return self._asdict()
+
+def parse_clip(blob: bytes):
+    # Returns the header, or None for a headerless upload, and the payload as a view into blob.
+    if len(blob) < len(CLIP_HEADER_MAGIC) or blob[:4] != CLIP_HEADER_MAGIC:
+        return None, memoryview(blob)
+    if len(blob) < CLIP_HEADER.size:
+        raise ValueError("Truncated clip header")
+    (
+        _magic, version, codec, header_size, mac, flags, capture_start_us, sample_rate,
+        sample_count, sequence, min_sample, max_sample, non_zero_samples, gain_log2,
+    ) = CLIP_HEADER.unpack_from(blob)
+    if header_size < CLIP_HEADER.size or header_size > len(blob):
+        raise ValueError(f"Invalid clip header size {header_size}")
+    if codec not in CLIP_CODEC_ENCODINGS:
+        raise ValueError(f"Unsupported clip codec {codec}")
+    window_offset, window_sample_count = 0, 0
+    if header_size >= CLIP_HEADER.size + CLIP_HEADER_WINDOW.size:
+        window_offset, window_sample_count = CLIP_HEADER_WINDOW.unpack_from(blob, CLIP_HEADER.size)
+    first_sample, stream_id, hop_samples = 0, 0, 0
+    stream_offset = CLIP_HEADER.size + CLIP_HEADER_WINDOW.size
+    if header_size >= stream_offset + CLIP_HEADER_STREAM.size:
+        first_sample, stream_id, hop_samples = CLIP_HEADER_STREAM.unpack_from(blob, stream_offset)
+    header = ClipHeader(
+        version=version,
+        encoding=CLIP_CODEC_ENCODINGS[codec],
+        device_mac=mac.hex(":"),
+        complete=bool(flags & CLIP_FLAG_COMPLETE),
+        heartbeat=bool(flags & CLIP_FLAG_HEARTBEAT),
+        capture_start_us=capture_start_us,
+        sample_rate=sample_rate,
+        sample_count=sample_count,
+        sequence=sequence,
+        min_sample=min_sample,
+        max_sample=max_sample,
+        non_zero_samples=non_zero_samples,
+        gain_log2=gain_log2,
+        trimmed=bool(flags & CLIP_FLAG_TRIMMED),
+        window_offset=window_offset,
+        window_sample_count=window_sample_count,
+        first_sample=first_sample,
+        stream_id=stream_id,
+        hop_samples=hop_samples,
+    )
+    return header, memoryview(blob)[header_size:]
+
+def parse_heartbeat(payload):
+    # Returns (windows_suppressed, samples_suppressed).
+    if len(payload) < CLIP_HEARTBEAT.size:
+        raise ValueError("Truncated heartbeat")
+    return CLIP_HEARTBEAT.unpack_from(payload)
+
+class RecentClips:
+    # Remembers the last few thousand accepted clips so a clip the device sends again after a lost
+    # response is recognised. Sequence numbers restart at boot, so the capture time is part of the
+    # key, and clips captured before the device's clock was set cannot be told apart and are
+    # never treated as duplicates.
+    def __init__(self, capacity: int = 4096):
+        self._capacity = capacity
+        self._keys = OrderedDict()
+        self._lock = threading.Lock()
+
+    @staticmethod
+    def _key(header: ClipHeader):
+        return (header.device_mac, header.sequence, header.capture_start_us)
+
+    def contains(self, header: ClipHeader) -> bool:
+        if header.capture_start_us == 0:
+            return False
+        with self._lock:
+            return self._key(header) in self._keys
+
+    def add(self, header: ClipHeader):
+        if header.capture_start_us == 0:
+            return
+        with self._lock:
+            self._keys[self._key(header)] = None
+            while len(self._keys) > self._capacity:
+                self._keys.popitem(last=False)
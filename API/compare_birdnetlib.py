@@ -0,0 +1,88 @@
+# Runs one clip through birdnetlib's own Recording.analyze() and through analyze_batched(), which
+# calls the analyzer's interpreter directly, and reports any detection that differs. Run it before
+# setting INFERENCE_BATCHED=1 and after upgrading birdnetlib or the model. Without a clip it uses
+# the firmware's rock_dove_bin fixture.
+# Usage: python compare_birdnetlib.py [CLIP.wav | CLIP.pcm] [--sample-rate HZ]
+import argparse
+import os
+import re
+import sys
+import tempfile
+import wave
+
+from birdnetlib import Recording
+
+# The batched path is only set up when enabled.
+os.environ["INFERENCE_BATCHED"] = "1"
+from birdnet import (
+    DATE, LATITUDE, LONGITUDE, MIN_CONFIDENCE, SAMPLE_RATE, analyze_batched, analyzer, scheduler,
+)
+
+FIXTURE = os.path.join(os.path.dirname(__file__), "..", "ESP_Code", "main", "rock_dove.h")
+# The two paths resample and run the same float32 model, so scores should agree closely.
+CONFIDENCE_TOLERANCE = 1e-3
+
+def load_clip(path, sample_rate):
+    # Returns PCM16LE bytes and their rate.
+    if path is None:
+        with open(FIXTURE) as f:
+            text = f.read()
+        body = text[text.index("{") + 1 : text.index("}")]
+        return bytes(int(value, 16) for value in re.findall(r"0x[0-9a-fA-F]+", body)), sample_rate
+    if path.endswith(".wav"):
+        with wave.open(path, "rb") as wav_file:
+            if wav_file.getnchannels() != 1 or wav_file.getsampwidth() != 2:
+                raise ValueError("Only mono 16-bit WAV clips are supported")
+            return wav_file.readframes(wav_file.getnframes()), wav_file.getframerate()
+    with open(path, "rb") as f:
+        return f.read(), sample_rate
+
+def analyze_with_recording(pcm, sample_rate):
+    # The API's analysis before batching: the clip as a WAV file through birdnetlib.
+    with tempfile.NamedTemporaryFile(suffix=".wav", delete=False) as temp_audio_file:
+        with wave.open(temp_audio_file, "wb") as wav_file:
+            wav_file.setnchannels(1)
+            wav_file.setsampwidth(2)
+            wav_file.setframerate(sample_rate)
+            wav_file.writeframes(pcm)
+    try:
+        recording = Recording(
+            analyzer,
+            temp_audio_file.name,
+            lat=LATITUDE,
+            lon=LONGITUDE,
+            date=DATE,
+            min_conf=MIN_CONFIDENCE,
+        )
+        recording.analyze()
+    finally:
+        os.remove(temp_audio_file.name)
+    return recording.detections
+
+def detection_key(detection):
+    return (detection["label"], round(detection["start_time"], 3), round(detection["end_time"], 3))
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("clip", nargs="?")
+    parser.add_argument("--sample-rate", type=int, default=SAMPLE_RATE)
+    args = parser.parse_args()
+
+    pcm, sample_rate = load_clip(args.clip, args.sample_rate)
+    # Recording runs first, before the batching thread resizes the shared interpreter's input.
+    expected = {detection_key(d): d["confidence"] for d in analyze_with_recording(pcm, sample_rate)}
+    actual = {detection_key(d): d["confidence"] for d in analyze_batched(pcm, sample_rate)}
+    print(f"birdnetlib: {len(expected)} detections, analyze_batched: {len(actual)}, batches: {scheduler.metrics()['batches']}")
+
+    mismatches = 0
+    for key in sorted(expected.keys() | actual.keys()):
+        want = expected.get(key)
+        got = actual.get(key)
+        if want is None or got is None or abs(want - got) > CONFIDENCE_TOLERANCE:
+            mismatches += 1
+            print(f"  {key[0]} {key[1]:.1f}-{key[2]:.1f} s: birdnetlib {want}, analyze_batched {got}")
+    print("detections match" if mismatches == 0 else f"{mismatches} detections differ")
+    return 0 if mismatches == 0 else 1
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,132 @@
+import math
+import queue
+import threading
+import time
+import uuid
+from collections import OrderedDict
+
+class _Timing:
+    # Running count, mean and maximum of a duration in seconds.
+    def __init__(self):
+        self.count = 0
+        self.total = 0.0
+        self.max = 0.0
+        self.last = 0.0
+
+    def add(self, seconds: float):
+        self.count += 1
+        self.total += seconds
+        self.max = max(self.max, seconds)
+        self.last = seconds
+
+    @property
+    def mean(self) -> float:
+        return self.total / self.count if self.count else 0.0
+
+    def as_dict(self):
+        return {"count": self.count, "last": self.last, "mean": self.mean, "max": self.max}
+
+class IngestQueue:
+    # Bounded FIFO of uploads processed by a fixed pool of worker threads, so the HTTP handler
+    # only has to enqueue. When the queue is full submit() returns None and the caller should
+    # ask the device to retry later. Finished jobs are kept for lookup, oldest dropped first.
+    def __init__(self, process, workers: int = 2, max_depth: int = 32, max_jobs: int = 1024):
+        self._process = process
+        self._workers = workers
+        self._queue = queue.Queue(maxsize=max_depth)
+        self._max_jobs = max_jobs
+        self._jobs = OrderedDict()
+        self._lock = threading.Lock()
+        self._started = False
+        self._wait = _Timing()
+        self._inference = _Timing()
+        self._submitted = 0
+        self._completed = 0
+        self._failed = 0
+        self._rejected = 0
+
+    def _start(self):
+        # Workers start with the first upload rather than at import, so the reloader's parent
+        # process does not run a pool of its own.
+        with self._lock:
+            if self._started:
+                return
+            self._started = True
+        for index in range(self._workers):
+            threading.Thread(target=self._run, name=f"ingest-{index}", daemon=True).start()
+
+    def submit(self, *args, metadata=None):
+        # metadata is stored with the job and returned by job().
+        self._start()
+        job_id = uuid.uuid4().hex
+        job = {"id": job_id, "status": "queued", "submitted_at": time.time()}
+        if metadata is not None:
+            job["clip"] = metadata
+        try:
+            self._queue.put_nowait((job, time.monotonic(), args))
+        except queue.Full:
+            with self._lock:
+                self._rejected += 1
+            return None
+        with self._lock:
+            self._submitted += 1
+            self._jobs[job_id] = job
+            while len(self._jobs) > self._max_jobs:
+                self._jobs.popitem(last=False)
+        return job_id
+
+    def job(self, job_id: str):
+        with self._lock:
+            job = self._jobs.get(job_id)
+            return dict(job) if job is not None else None
+
+    def depth(self) -> int:
+        return self._queue.qsize()
+
+    def retry_after_seconds(self) -> int:
+        # Time for the pool to work through the current backlog at the observed inference rate.
+        with self._lock:
+            mean = self._inference.mean or 1.0
+        return max(1, math.ceil(self.depth() * mean / self._workers))
+
+    def metrics(self):
+        with self._lock:
+            return {
+                "queue_depth": self._queue.qsize(),
+                "queue_capacity": self._queue.maxsize,
+                "workers": self._workers,
+                "jobs_submitted": self._submitted,
+                "jobs_completed": self._completed,
+                "jobs_failed": self._failed,
+                "jobs_rejected": self._rejected,
+                "wait_seconds": self._wait.as_dict(),
+                "inference_seconds": self._inference.as_dict(),
+            }
+
+    def _run(self):
+        while True:
+            job, enqueued_at, args = self._queue.get()
+            started_at = time.monotonic()
+            with self._lock:
+                self._wait.add(started_at - enqueued_at)
+                job["status"] = "running"
+                job["wait_seconds"] = started_at - enqueued_at
+            try:
+                result = self._process(*args)
+                error = None
+            except Exception as exception:
+                result = None
+                error = str(exception)
+            elapsed = time.monotonic() - started_at
+            with self._lock:
+                self._inference.add(elapsed)
+                job["inference_seconds"] = elapsed
+                if error is None:
+                    self._completed += 1
+                    job["status"] = "done"
+                    job["result"] = result
+                else:
+                    self._failed += 1
+                    job["status"] = "failed"
+                    job["error"] = error
+            self._queue.task_done()
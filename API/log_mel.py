@@ -0,0 +1,52 @@
+import math
+from typing import NamedTuple
+
+import numpy as np
+
+from clip_header import CLIP_LOG_MEL
+
+# The device amplifies by 2^gain_log2 before taking features; each step is about 6 dB.
+DB_PER_GAIN_STEP = 20 * math.log10(2)
+
+class LogMelFormat(NamedTuple):
+    fft_size: int
+    hop_samples: int
+    fmin_hz: int
+    fmax_hz: int
+    mel_bands: int
+    db_floor: int
+    db_step: float
+
+def decode_log_mel(payload, gain_log2: int = 0):
+    # Returns the format and a (frames, mel_bands) array of band levels in dB relative to a
+    # full-scale sine at the microphone, with the device's gain divided out.
+    if len(payload) < CLIP_LOG_MEL.size:
+        raise ValueError("Truncated log-mel header")
+    fft_size, hop_samples, fmin_hz, fmax_hz, mel_bands, db_floor, db_step_q8 = CLIP_LOG_MEL.unpack_from(payload)
+    if mel_bands == 0 or hop_samples == 0:
+        raise ValueError("Invalid log-mel header")
+    fmt = LogMelFormat(fft_size, hop_samples, fmin_hz, fmax_hz, mel_bands, db_floor, db_step_q8 / 256)
+    frames = np.frombuffer(payload, dtype=np.uint8, offset=CLIP_LOG_MEL.size)
+    if frames.size % mel_bands:
+        raise ValueError("Log-mel body is not a whole number of frames")
+    features = db_floor + frames.reshape(-1, mel_bands).astype(np.float32) * fmt.db_step
+    return fmt, features - gain_log2 * DB_PER_GAIN_STEP
+
+def mel_band_centres_hz(fmt: LogMelFormat) -> np.ndarray:
+    # Same mel scale and spacing as the device's filter bank.
+    mel_low = 2595 * math.log10(1 + fmt.fmin_hz / 700)
+    mel_high = 2595 * math.log10(1 + fmt.fmax_hz / 700)
+    mels = np.linspace(mel_low, mel_high, fmt.mel_bands + 2)[1:-1]
+    return 700 * (10 ** (mels / 2595) - 1)
+
+def summarize_features(fmt: LogMelFormat, features: np.ndarray, sample_rate: int):
+    hop_seconds = fmt.hop_samples / sample_rate
+    summary = {"frames": int(features.shape[0]), "mel_bands": fmt.mel_bands, "hop_seconds": hop_seconds}
+    if features.size:
+        frame, band = np.unravel_index(int(np.argmax(features)), features.shape)
+        summary.update(
+            peak_db=round(float(features[frame, band]), 1),
+            peak_seconds=round(frame * hop_seconds, 3),
+            peak_band_hz=round(float(mel_band_centres_hz(fmt)[band])),
+        )
+    return summary
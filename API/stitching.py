@@ -0,0 +1,42 @@
+import threading
+from collections import OrderedDict, deque
+
+class DetectionStitcher:
+    # Drops detections repeated by overlapping windows. Clip headers place each clip in its
+    # device's sample stream, so detections are moved onto the stream's timeline and one that
+    # overlaps an earlier detection of the same label by at least half its length is the same call
+    # heard again. Uploads are processed out of order, so every stream keeps its last max_detections
+    # detections; the max_streams most recently seen streams are kept.
+    def __init__(self, max_streams: int = 256, max_detections: int = 256):
+        self._max_streams = max_streams
+        self._max_detections = max_detections
+        self._streams = OrderedDict()
+        self._lock = threading.Lock()
+
+    def stitch(self, header, detections):
+        # Returns the detections not already reported, each with stream_start/stream_end in
+        # seconds since the device booted. Headers without a stream position pass through.
+        if header is None or header.stream_id == 0 or not header.sample_rate:
+            return detections
+        offset = header.first_sample / header.sample_rate
+        key = (header.device_mac, header.stream_id)
+        kept = []
+        with self._lock:
+            seen = self._streams.get(key)
+            if seen is None:
+                seen = self._streams[key] = deque(maxlen=self._max_detections)
+                while len(self._streams) > self._max_streams:
+                    self._streams.popitem(last=False)
+            self._streams.move_to_end(key)
+            for detection in detections:
+                start = offset + detection["start_time"]
+                end = offset + detection["end_time"]
+                half = (end - start) / 2
+                if any(
+                    label == detection["label"] and min(end, seen_end) - max(start, seen_start) >= half
+                    for label, seen_start, seen_end in seen
+                ):
+                    continue
+                seen.append((detection["label"], start, end))
+                kept.append({**detection, "stream_start": start, "stream_end": end})
+        return kept
@@ -0,0 +1,163 @@
+#include "activity_detector.h"
+
+#include <algorithm>
+#include <math.h>
+
+// Frames louder than the floor pull it up with a time constant of 2^FLOOR_RISE_SHIFT frames
+// (about 20 s at 20 ms frames); quieter ones pull it down within a few frames.
+static constexpr int FLOOR_RISE_SHIFT = 10;
+static constexpr int FLOOR_FALL_SHIFT = 2;
+// Keeps the floor off zero so digital silence does not make every click active.
+static constexpr uint64_t MIN_NOISE_FLOOR = 16;
+
+// Bird-band mode: Goertzel bins every BAND_SPACING_HZ, bird bins from 1 to 8 kHz, rumble bins below.
+static constexpr uint32_t BAND_SPACING_HZ = 250;
+static constexpr uint32_t BIRD_LOW_HZ = 1000;
+static constexpr uint32_t BIRD_HIGH_HZ = 8000;
+// A single bin fluctuates far more than broadband energy, so band floors settle over about 2^5
+// frames rather than sitting on the quietest recent frame.
+static constexpr int BAND_FALL_SHIFT = 5;
+// The most risen bird bin must have risen TONAL_RATIO times as much as the bird bins on average.
+static constexpr uint64_t TONAL_RATIO = 4;
+
+esp_err_t activity_detector_init(ActivityDetector* detector, size_t frame_samples, uint32_t threshold_db, uint32_t hangover_frames) {
+	if (detector == nullptr || frame_samples == 0) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	*detector = {};
+	detector->frame_samples = frame_samples;
+	detector->threshold_q8 = static_cast<uint32_t>(powf(10.0f, threshold_db / 10.0f) * 256.0f);
+	detector->hangover_frames = hangover_frames;
+	return ESP_OK;
+}
+
+esp_err_t activity_detector_init_bird_bands(ActivityDetector* detector, uint32_t sample_rate_hz, size_t frame_samples, uint32_t threshold_db, uint32_t hangover_frames) {
+	esp_err_t err = activity_detector_init(detector, frame_samples, threshold_db, hangover_frames);
+	if (err != ESP_OK) {
+		return err;
+	}
+
+	const size_t block_samples = sample_rate_hz / BAND_SPACING_HZ;
+	if (block_samples < 8 || block_samples > GOERTZEL_MAX_BLOCK) {
+		return ESP_ERR_NOT_SUPPORTED;
+	}
+	const uint16_t first_bird = static_cast<uint16_t>((BIRD_LOW_HZ + BAND_SPACING_HZ - 1) / BAND_SPACING_HZ);
+	const uint16_t last_bird = static_cast<uint16_t>(std::min<size_t>(BIRD_HIGH_HZ / BAND_SPACING_HZ, block_samples / 2 - 1));
+	if (last_bird < first_bird) {
+		return ESP_ERR_NOT_SUPPORTED;
+	}
+
+	uint16_t bins[GOERTZEL_MAX_BINS] = {};
+	size_t bin_count = 0;
+	for (uint16_t bin = first_bird; bin <= last_bird && bin_count < GOERTZEL_MAX_BINS; ++bin) {
+		bins[bin_count++] = bin;
+	}
+	detector->bird_bins = bin_count;
+	for (uint16_t bin = 1; bin < first_bird && bin_count < GOERTZEL_MAX_BINS; ++bin) {
+		bins[bin_count++] = bin;
+	}
+	return goertzel_bank_init(&detector->bands, block_samples, bins, bin_count);
+}
+
+// Moves a Q8 floor towards value_q8, quickly downwards and slowly upwards.
+static void track_floor(uint64_t* floor, uint64_t value_q8, int fall_shift = FLOOR_FALL_SHIFT) {
+	if (value_q8 < *floor) {
+		*floor -= (*floor - value_q8) >> fall_shift;
+	} else {
+		*floor += (value_q8 - *floor) >> FLOOR_RISE_SHIFT;
+	}
+	*floor = std::max(*floor, MIN_NOISE_FLOOR);
+}
+
+// Rise of a bin's power over its floor, Q8.
+static uint64_t band_rise_q8(uint64_t power, uint64_t floor_q8) {
+	return (power << 16) / floor_q8;
+}
+
+// Bird-band score of a finished frame: the largest bird-bin rise, or 0 when the frame is not tonal
+// or the rumble bins rose as much. Updates the band floors.
+static uint64_t score_bands(ActivityDetector* detector, uint8_t gain_log2) {
+	uint64_t powers[GOERTZEL_MAX_BINS];
+	goertzel_bank_read(&detector->bands, powers, 2 * gain_log2);
+	const size_t bin_count = detector->bands.bin_count;
+	if (!detector->primed) {
+		for (size_t bin = 0; bin < bin_count; ++bin) {
+			detector->band_floor[bin] = std::max(powers[bin] << 8, MIN_NOISE_FLOOR);
+		}
+	}
+
+	uint64_t peak_rise = 0;
+	uint64_t bird_rise_sum = 0;
+	for (size_t bin = 0; bin < detector->bird_bins; ++bin) {
+		const uint64_t rise = band_rise_q8(powers[bin], detector->band_floor[bin]);
+		peak_rise = std::max(peak_rise, rise);
+		bird_rise_sum += rise;
+	}
+	uint64_t rumble_rise_sum = 0;
+	for (size_t bin = detector->bird_bins; bin < bin_count; ++bin) {
+		rumble_rise_sum += band_rise_q8(powers[bin], detector->band_floor[bin]);
+	}
+	const size_t rumble_bins = bin_count - detector->bird_bins;
+	const uint64_t rumble_rise = std::max<uint64_t>(rumble_bins > 0 ? rumble_rise_sum / rumble_bins : 0, 256);
+
+	for (size_t bin = 0; bin < bin_count; ++bin) {
+		track_floor(&detector->band_floor[bin], powers[bin] << 8, BAND_FALL_SHIFT);
+	}
+
+	if (peak_rise * detector->bird_bins < bird_rise_sum * TONAL_RATIO) {
+		return 0;
+	}
+	// Scale so that a band which rose exactly as much as the rumble scores unity (256).
+	return (peak_rise << 8) / rumble_rise;
+}
+
+// Classifies one finished frame and updates the floors.
+static bool finish_frame(ActivityDetector* detector, uint8_t gain_log2) {
+	bool loud = false;
+	if (detector->bird_bins > 0) {
+		loud = score_bands(detector, gain_log2) > detector->threshold_q8;
+		detector->primed = true;
+	} else {
+		const uint64_t mean_square = ((detector->frame_energy << 8) / detector->frame_samples) >> (2 * gain_log2);
+		if (!detector->primed) {
+			detector->noise_floor = mean_square;
+			detector->primed = true;
+		}
+		loud = mean_square * 256 > detector->noise_floor * detector->threshold_q8;
+		track_floor(&detector->noise_floor, mean_square);
+	}
+	detector->frame_energy = 0;
+	detector->frame_fill = 0;
+
+	if (loud) {
+		detector->hangover_left = detector->hangover_frames;
+		return true;
+	}
+	if (detector->hangover_left > 0) {
+		--detector->hangover_left;
+		return true;
+	}
+	return false;
+}
+
+size_t activity_detector_process(ActivityDetector* detector, const int16_t* samples, size_t sample_count, uint8_t gain_log2) {
+	size_t active_frames = 0;
+	while (sample_count > 0) {
+		const size_t chunk = std::min(sample_count, detector->frame_samples - detector->frame_fill);
+		if (detector->bird_bins > 0) {
+			goertzel_bank_process(&detector->bands, samples, chunk);
+		} else {
+			for (size_t index = 0; index < chunk; ++index) {
+				const int32_t sample = samples[index];
+				detector->frame_energy += static_cast<uint64_t>(sample * sample);
+			}
+		}
+		detector->frame_fill += chunk;
+		samples += chunk;
+		sample_count -= chunk;
+		if (detector->frame_fill == detector->frame_samples && finish_frame(detector, gain_log2)) {
+			++active_frames;
+		}
+	}
+	return active_frames;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "goertzel_bank.h"
+
+// Energy voice-activity detector. Samples are cut into fixed frames; a frame is active when its
+// mean-square energy is threshold above an adaptive noise floor, and activity is held for a
+// hangover after the last loud frame so call tails and gaps between syllables are kept. The floor
+// follows quieter frames quickly and louder ones only slowly, so steady noise such as wind or rain
+// is learned while calls stand out. Energies are compared at unity gain, so the capture path's
+// gain steps do not look like activity.
+struct ActivityDetector {
+	size_t frame_samples;
+	size_t frame_fill;
+	uint64_t frame_energy;
+	uint64_t noise_floor;     // mean square at unity gain, Q8
+	uint32_t threshold_q8;    // energy ratio over the floor, Q8
+	uint32_t hangover_frames;
+	uint32_t hangover_left;
+	bool primed;
+	// Bird-band mode only: bins[0, bird_bins) span 1-8 kHz, the rest lie below 1 kHz. Each bin has
+	// its own floor, so a frame is scored by how far each band rose above its usual level.
+	GoertzelBank bands;
+	size_t bird_bins;
+	uint64_t band_floor[GOERTZEL_MAX_BINS];  // bin power at unity gain, Q8
+};
+
+esp_err_t activity_detector_init(ActivityDetector* detector, size_t frame_samples, uint32_t threshold_db, uint32_t hangover_frames);
+// Scores frames by Goertzel bins between 1 and 8 kHz instead of broadband energy. A frame is loud
+// when its most risen bird bin is threshold above its floor, has risen well beyond the average bird
+// bin, so broadband noise does not count, and has risen threshold further than the bins below 1 kHz,
+// so a gust of wind or a passing car that lifts every band is not taken for a call. Returns
+// ESP_ERR_NOT_SUPPORTED when sample_rate_hz leaves no bird band below Nyquist.
+esp_err_t activity_detector_init_bird_bands(ActivityDetector* detector, uint32_t sample_rate_hz, size_t frame_samples, uint32_t threshold_db, uint32_t hangover_frames);
+
+// Consumes samples that were amplified by 2^gain_log2 and returns how many frames completed by them
+// were active. A frame may span calls.
+size_t activity_detector_process(ActivityDetector* detector, const int16_t* samples, size_t sample_count, uint8_t gain_log2);
@@ -0,0 +1,94 @@
+#include "adpcm_encoder.h"
+
+static const int16_t STEP_TABLE[89] = {
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31,
+	34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143,
+	157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658,
+	724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024,
+	3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767,
+};
+
+static const int8_t INDEX_TABLE[16] = {
+	-1, -1, -1, -1, 2, 4, 6, 8,
+	-1, -1, -1, -1, 2, 4, 6, 8,
+};
+
+static uint8_t encode_nibble(AdpcmEncoder* encoder, int16_t sample) {
+	int32_t step = STEP_TABLE[encoder->step_index];
+	int32_t diff = static_cast<int32_t>(sample) - encoder->predictor;
+	uint8_t nibble = 0;
+	if (diff < 0) {
+		nibble = 8;
+		diff = -diff;
+	}
+
+	// Successive approximation of diff / step in three bits, tracking the value the decoder will
+	// reconstruct so encoder and decoder predictors never drift apart.
+	int32_t reconstructed = step >> 3;
+	if (diff >= step) {
+		nibble |= 4;
+		diff -= step;
+		reconstructed += step;
+	}
+	step >>= 1;
+	if (diff >= step) {
+		nibble |= 2;
+		diff -= step;
+		reconstructed += step;
+	}
+	step >>= 1;
+	if (diff >= step) {
+		nibble |= 1;
+		reconstructed += step;
+	}
+
+	int32_t predictor = encoder->predictor + ((nibble & 8) != 0 ? -reconstructed : reconstructed);
+	if (predictor > 32767) {
+		predictor = 32767;
+	} else if (predictor < -32768) {
+		predictor = -32768;
+	}
+	encoder->predictor = predictor;
+
+	int32_t step_index = encoder->step_index + INDEX_TABLE[nibble];
+	if (step_index < 0) {
+		step_index = 0;
+	} else if (step_index > 88) {
+		step_index = 88;
+	}
+	encoder->step_index = step_index;
+
+	return nibble;
+}
+
+void adpcm_encoder_reset(AdpcmEncoder* encoder) {
+	encoder->predictor = 0;
+	encoder->step_index = 0;
+	encoder->pending_byte = 0;
+	encoder->has_pending = false;
+}
+
+size_t adpcm_encoder_encode(AdpcmEncoder* encoder, const int16_t* samples, size_t sample_count, uint8_t* output) {
+	size_t written = 0;
+	for (size_t index = 0; index < sample_count; ++index) {
+		const uint8_t nibble = encode_nibble(encoder, samples[index]);
+		if (encoder->has_pending) {
+			output[written++] = static_cast<uint8_t>(encoder->pending_byte | (nibble << 4));
+			encoder->has_pending = false;
+		} else {
+			encoder->pending_byte = nibble;
+			encoder->has_pending = true;
+		}
+	}
+	return written;
+}
+
+size_t adpcm_encoder_flush(AdpcmEncoder* encoder, uint8_t* output) {
+	if (!encoder->has_pending) {
+		return 0;
+	}
+	output[0] = encoder->pending_byte;
+	encoder->has_pending = false;
+	return 1;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming IMA/DVI ADPCM encoder: 4 bits per PCM16 sample, two samples per byte, low nibble
+// first (the WAV IMA ADPCM ordering). Predictor and step state carry across calls, so a window
+// can be encoded one chunk at a time; an odd trailing sample is held until the next call or flush.
+struct AdpcmEncoder {
+	int32_t predictor;
+	int32_t step_index;
+	uint8_t pending_byte;
+	bool has_pending;
+};
+
+void adpcm_encoder_reset(AdpcmEncoder* encoder);
+
+// Writes at most (sample_count + 1) / 2 bytes to output and returns the number written.
+size_t adpcm_encoder_encode(AdpcmEncoder* encoder, const int16_t* samples, size_t sample_count, uint8_t* output);
+
+// Emits a held odd sample padded with a zero nibble. Returns 0 or 1.
+size_t adpcm_encoder_flush(AdpcmEncoder* encoder, uint8_t* output);
@@ -0,0 +1,63 @@
+#include "audio_ring.h"
+
+#include <algorithm>
+
+void audio_ring_init(AudioRing* ring, int16_t* storage, size_t capacity) {
+	ring->samples = storage;
+	ring->capacity = capacity;
+	ring->head = 0;
+	ring->tail = 0;
+	portMUX_INITIALIZE(&ring->lock);
+}
+
+int16_t* audio_ring_reserve(AudioRing* ring, size_t* contiguous) {
+	portENTER_CRITICAL(&ring->lock);
+	const uint64_t head = ring->head;
+	const size_t used = static_cast<size_t>(head - ring->tail);
+	portEXIT_CRITICAL(&ring->lock);
+
+	const size_t offset = static_cast<size_t>(head % ring->capacity);
+	*contiguous = std::min(ring->capacity - used, ring->capacity - offset);
+	return ring->samples + offset;
+}
+
+void audio_ring_commit(AudioRing* ring, size_t count) {
+	portENTER_CRITICAL(&ring->lock);
+	ring->head += count;
+	portEXIT_CRITICAL(&ring->lock);
+}
+
+const int16_t* audio_ring_peek(const AudioRing* ring, uint64_t index, size_t* contiguous) {
+	const size_t offset = static_cast<size_t>(index % ring->capacity);
+	*contiguous = ring->capacity - offset;
+	return ring->samples + offset;
+}
+
+void audio_ring_release(AudioRing* ring, uint64_t index) {
+	portENTER_CRITICAL(&ring->lock);
+	if (index > ring->tail) {
+		ring->tail = std::min(index, ring->head);
+	}
+	portEXIT_CRITICAL(&ring->lock);
+}
+
+uint64_t audio_ring_head(AudioRing* ring) {
+	portENTER_CRITICAL(&ring->lock);
+	const uint64_t head = ring->head;
+	portEXIT_CRITICAL(&ring->lock);
+	return head;
+}
+
+uint64_t audio_ring_tail(AudioRing* ring) {
+	portENTER_CRITICAL(&ring->lock);
+	const uint64_t tail = ring->tail;
+	portEXIT_CRITICAL(&ring->lock);
+	return tail;
+}
+
+size_t audio_ring_free(AudioRing* ring) {
+	portENTER_CRITICAL(&ring->lock);
+	const size_t used = static_cast<size_t>(ring->head - ring->tail);
+	portEXIT_CRITICAL(&ring->lock);
+	return ring->capacity - used;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+
+// Single-producer/single-consumer ring of PCM16 samples shared by the capture and upload tasks.
+// Positions are absolute sample indices since capture start, so the consumer can hold on to a
+// span by index while the producer keeps writing behind it.
+struct AudioRing {
+	int16_t* samples;
+	size_t capacity;
+	uint64_t head;
+	uint64_t tail;
+	portMUX_TYPE lock;
+};
+
+void audio_ring_init(AudioRing* ring, int16_t* storage, size_t capacity);
+
+// Producer side: contiguous free region starting at head, bounded by the wrap point and tail.
+int16_t* audio_ring_reserve(AudioRing* ring, size_t* contiguous);
+void audio_ring_commit(AudioRing* ring, size_t count);
+
+// Consumer side: samples at an absolute index, and release of everything before an index.
+const int16_t* audio_ring_peek(const AudioRing* ring, uint64_t index, size_t* contiguous);
+void audio_ring_release(AudioRing* ring, uint64_t index);
+
+uint64_t audio_ring_head(AudioRing* ring);
+uint64_t audio_ring_tail(AudioRing* ring);
+size_t audio_ring_free(AudioRing* ring);
@@ -0,0 +1,232 @@
+#include "bird_classifier.h"
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "log_mel_encoder.h"
+#include "sdkconfig.h"
+
+#if CONFIG_MIC_CLASSIFIER_ENABLE
+#include "tensorflow/lite/micro/micro_interpreter.h"
+#include "tensorflow/lite/micro/micro_mutable_op_resolver.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+
+static constexpr size_t ARENA_BYTES = CONFIG_MIC_CLASSIFIER_ARENA_KB * 1024;
+// The ops a small conv net for spectrogram patches needs; ESP-NN provides the int8 kernels.
+static constexpr int MAX_OPS = 10;
+static const char* TAG = "bird_classifier";
+
+alignas(16) static uint8_t s_arena[ARENA_BYTES];
+static tflite::MicroInterpreter* s_interpreter = nullptr;
+static esp_partition_mmap_handle_t s_model_mmap;
+static BirdModelHeader s_header;
+static LogMelEncoder s_features;
+static BirdClassifierStats s_stats;
+
+// Patch being assembled straight in the input tensor, and the best score of the window so far.
+static int8_t* s_input = nullptr;
+static size_t s_patch_frames = 0;
+static uint8_t s_window_score = 0;
+// Feature byte to model input, rebuilt per window since it folds in the window's gain.
+static int8_t s_input_lut[256];
+
+static esp_err_t check_header(const esp_partition_t* partition, const uint8_t* mapped, uint32_t sample_rate) {
+	memcpy(&s_header, mapped, sizeof(s_header));
+	if (memcmp(s_header.magic, BIRD_MODEL_MAGIC, sizeof(s_header.magic)) != 0 || s_header.version != BIRD_MODEL_VERSION) {
+		ESP_LOGW(TAG, "No model in partition \"%s\"", partition->label);
+		return ESP_ERR_NOT_FOUND;
+	}
+	if (s_header.header_size < sizeof(s_header) || s_header.header_size % 16 != 0 || s_header.header_size + s_header.model_size > partition->size) {
+		ESP_LOGE(TAG, "Model header does not fit partition \"%s\"", partition->label);
+		return ESP_ERR_INVALID_SIZE;
+	}
+	if (esp_rom_crc32_le(0, mapped + s_header.header_size, s_header.model_size) != s_header.model_crc) {
+		ESP_LOGE(TAG, "Model CRC mismatch");
+		return ESP_ERR_INVALID_CRC;
+	}
+	if (s_header.sample_rate != sample_rate) {
+		ESP_LOGE(TAG, "Model expects %u Hz, uploads are %u Hz", static_cast<unsigned>(s_header.sample_rate), static_cast<unsigned>(sample_rate));
+		return ESP_ERR_NOT_SUPPORTED;
+	}
+	return ESP_OK;
+}
+
+static esp_err_t check_tensors(const TfLiteTensor* input, const TfLiteTensor* output) {
+	size_t input_elements = 1;
+	for (int dim = 0; dim < input->dims->size; ++dim) {
+		input_elements *= static_cast<size_t>(input->dims->data[dim]);
+	}
+	const int output_classes = output->dims->data[output->dims->size - 1];
+	if (input->type != kTfLiteInt8 || output->type != kTfLiteInt8 || input_elements != static_cast<size_t>(s_header.frames) * s_header.mel_bands ||
+	    s_header.bird_class >= output_classes) {
+		ESP_LOGE(TAG, "Model tensors do not match its header (%u x %u features, class %u)", s_header.frames, s_header.mel_bands, s_header.bird_class);
+		return ESP_ERR_INVALID_ARG;
+	}
+	return ESP_OK;
+}
+
+esp_err_t bird_classifier_init(const char* partition_label, uint32_t sample_rate) {
+	const esp_partition_t* partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partition_label);
+	if (partition == nullptr) {
+		ESP_LOGE(TAG, "Partition \"%s\" not found", partition_label);
+		return ESP_ERR_NOT_FOUND;
+	}
+	// The flatbuffer is read in place through the flash cache; only the arena is in RAM.
+	const void* mapped = nullptr;
+	esp_err_t err = esp_partition_mmap(partition, 0, partition->size, ESP_PARTITION_MMAP_DATA, &mapped, &s_model_mmap);
+	if (err != ESP_OK) {
+		return err;
+	}
+	const uint8_t* bytes = static_cast<const uint8_t*>(mapped);
+	err = check_header(partition, bytes, sample_rate);
+	if (err == ESP_OK) {
+		err = log_mel_encoder_init(&s_features, sample_rate, s_header.fft_size, s_header.hop_samples, s_header.mel_bands, s_header.fmin_hz, s_header.fmax_hz);
+	}
+
+	const tflite::Model* model = err == ESP_OK ? tflite::GetModel(bytes + s_header.header_size) : nullptr;
+	if (model != nullptr && model->version() != TFLITE_SCHEMA_VERSION) {
+		ESP_LOGE(TAG, "Model schema %u, expected %d", static_cast<unsigned>(model->version()), TFLITE_SCHEMA_VERSION);
+		err = ESP_ERR_NOT_SUPPORTED;
+	}
+	if (err != ESP_OK) {
+		esp_partition_munmap(s_model_mmap);
+		return err;
+	}
+
+	static tflite::MicroMutableOpResolver<MAX_OPS> resolver;
+	resolver.AddConv2D();
+	resolver.AddDepthwiseConv2D();
+	resolver.AddFullyConnected();
+	resolver.AddMaxPool2D();
+	resolver.AddAveragePool2D();
+	resolver.AddMean();
+	resolver.AddReshape();
+	resolver.AddSoftmax();
+	resolver.AddLogistic();
+	resolver.AddQuantize();
+	static tflite::MicroInterpreter interpreter(model, resolver, s_arena, ARENA_BYTES);
+	if (interpreter.AllocateTensors() != kTfLiteOk) {
+		ESP_LOGE(TAG, "Model does not fit the %u byte arena", static_cast<unsigned>(ARENA_BYTES));
+		return ESP_ERR_NO_MEM;
+	}
+	err = check_tensors(interpreter.input(0), interpreter.output(0));
+	if (err != ESP_OK) {
+		return err;
+	}
+
+	s_interpreter = &interpreter;
+	s_input = interpreter.input(0)->data.int8;
+	s_stats.arena_used_bytes = interpreter.arena_used_bytes();
+	ESP_LOGI(
+		TAG,
+		"Model: %u bytes, %u x %u features every %u samples, arena %u of %u bytes",
+		static_cast<unsigned>(s_header.model_size),
+		s_header.frames,
+		s_header.mel_bands,
+		s_header.hop_samples,
+		static_cast<unsigned>(s_stats.arena_used_bytes),
+		static_cast<unsigned>(ARENA_BYTES)
+	);
+	return ESP_OK;
+}
+
+bool bird_classifier_ready() {
+	return s_interpreter != nullptr;
+}
+
+void bird_classifier_begin(uint8_t gain_log2) {
+	if (!bird_classifier_ready()) {
+		return;
+	}
+	const TfLiteTensor* input = s_interpreter->input(0);
+	const float gain_db = 6.0206f * gain_log2;
+	for (int value = 0; value < 256; ++value) {
+		const float db = LOG_MEL_DB_FLOOR + value * (LOG_MEL_DB_STEP_Q8 / 256.0f) - gain_db;
+		const long quantized = lrintf(db / input->params.scale) + input->params.zero_point;
+		s_input_lut[value] = static_cast<int8_t>(std::clamp<long>(quantized, -128, 127));
+	}
+	log_mel_encoder_reset(&s_features);
+	s_patch_frames = 0;
+	s_window_score = 0;
+}
+
+static void score_patch() {
+	const int64_t start_us = esp_timer_get_time();
+	if (s_interpreter->Invoke() != kTfLiteOk) {
+		ESP_LOGW(TAG, "Invoke failed");
+		return;
+	}
+	const uint32_t elapsed_us = static_cast<uint32_t>(esp_timer_get_time() - start_us);
+	++s_stats.invocations;
+	s_stats.last_invoke_us = elapsed_us;
+	s_stats.max_invoke_us = std::max(s_stats.max_invoke_us, elapsed_us);
+
+	const TfLiteTensor* output = s_interpreter->output(0);
+	const float probability = (output->data.int8[s_header.bird_class] - output->params.zero_point) * output->params.scale;
+	s_window_score = std::max(s_window_score, static_cast<uint8_t>(std::clamp(lrintf(probability * 100.0f), 0L, 100L)));
+}
+
+static esp_err_t append_frame(const uint8_t* frame, size_t length, void* user_ctx) {
+	int8_t* row = s_input + s_patch_frames * s_header.mel_bands;
+	for (size_t band = 0; band < length; ++band) {
+		row[band] = s_input_lut[frame[band]];
+	}
+	if (++s_patch_frames == s_header.frames) {
+		score_patch();
+		s_patch_frames = 0;
+	}
+	return ESP_OK;
+}
+
+void bird_classifier_write(const int16_t* samples, size_t sample_count) {
+	if (bird_classifier_ready()) {
+		log_mel_encoder_write(&s_features, samples, sample_count, append_frame, nullptr);
+	}
+}
+
+uint8_t bird_classifier_finish() {
+	if (!bird_classifier_ready()) {
+		return 100;
+	}
+	if (s_patch_frames > 0 && s_patch_frames * 2 >= s_header.frames) {
+		memset(s_input + s_patch_frames * s_header.mel_bands, s_input_lut[0], (s_header.frames - s_patch_frames) * s_header.mel_bands);
+		score_patch();
+	}
+	s_patch_frames = 0;
+	++s_stats.windows_scored;
+	return s_window_score;
+}
+#else
+esp_err_t bird_classifier_init(const char* partition_label, uint32_t sample_rate) {
+	return ESP_ERR_NOT_SUPPORTED;
+}
+
+bool bird_classifier_ready() {
+	return false;
+}
+
+void bird_classifier_begin(uint8_t gain_log2) {}
+
+void bird_classifier_write(const int16_t* samples, size_t sample_count) {}
+
+uint8_t bird_classifier_finish() {
+	return 100;
+}
+
+static BirdClassifierStats s_stats;
+#endif
+
+void bird_classifier_count(bool rejected) {
+	if (rejected) {
+		++s_stats.windows_rejected;
+	}
+}
+
+void bird_classifier_get_stats(BirdClassifierStats* stats) {
+	*stats = s_stats;
+}
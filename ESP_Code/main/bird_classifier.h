@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Header at offset 0 of the model partition, written by ESP_Code/tools/pack_model.py. The TFLite
+// flatbuffer follows at header_size and describes an int8 model taking a [1, frames, mel_bands, 1]
+// (or [1, frames, mel_bands]) log-mel patch in dB and giving class probabilities, bird_class being
+// the "bird" one. The feature fields say how the patch was computed at training time.
+static constexpr uint8_t BIRD_MODEL_MAGIC[4] = {'B', 'S', 'M', 'D'};
+static constexpr uint16_t BIRD_MODEL_VERSION = 1;
+
+struct BirdModelHeader {
+	uint8_t magic[4];
+	uint16_t version;
+	uint16_t header_size;
+	uint32_t model_size;
+	uint32_t model_crc;  // esp_rom_crc32_le of the flatbuffer
+	uint32_t sample_rate;
+	uint16_t fft_size;
+	uint16_t hop_samples;
+	uint16_t fmin_hz;
+	uint16_t fmax_hz;
+	uint16_t frames;
+	uint8_t mel_bands;
+	uint8_t bird_class;
+	uint8_t reserved[32];
+};
+
+static_assert(sizeof(BirdModelHeader) == 64, "BirdModelHeader layout is shared with pack_model.py");
+
+struct BirdClassifierStats {
+	uint32_t windows_scored;
+	uint32_t windows_rejected;
+	uint32_t invocations;
+	uint32_t last_invoke_us;
+	uint32_t max_invoke_us;
+	size_t arena_used_bytes;
+};
+
+// Maps the model from the partition, checks it against its header and sample_rate and builds the
+// interpreter on a static arena of CONFIG_MIC_CLASSIFIER_ARENA_KB. Fails, leaving the classifier
+// unready, when the partition holds no valid model.
+esp_err_t bird_classifier_init(const char* partition_label, uint32_t sample_rate);
+bool bird_classifier_ready();
+
+// Scores a window streamed through write: features are computed as samples arrive and the model
+// runs on every frames-long patch. A final patch at least half full is padded and scored too.
+// gain_log2 is the gain the window's samples were captured with; it is divided out of the features.
+void bird_classifier_begin(uint8_t gain_log2);
+void bird_classifier_write(const int16_t* samples, size_t sample_count);
+// Returns the highest bird probability of any patch in the window, in percent.
+uint8_t bird_classifier_finish();
+
+// Counts a window the caller dropped on the classifier's score.
+void bird_classifier_count(bool rejected);
+void bird_classifier_get_stats(BirdClassifierStats* stats);
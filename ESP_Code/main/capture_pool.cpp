@@ -0,0 +1,33 @@
+#include "capture_pool.h"
+
+#include "esp_heap_caps.h"
+#include "sdkconfig.h"
+
+static constexpr size_t POOL_ALIGN = 4;
+
+esp_err_t capture_pool_init(CapturePool* pool, size_t size) {
+	*pool = {};
+#if CONFIG_SPIRAM
+	// Samples are only touched by the CPU, so the slower external RAM costs little.
+	pool->base = static_cast<uint8_t*>(heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT));
+	pool->external = pool->base != nullptr;
+#endif
+	if (pool->base == nullptr) {
+		pool->base = static_cast<uint8_t*>(heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA | MALLOC_CAP_8BIT));
+	}
+	if (pool->base == nullptr) {
+		return ESP_ERR_NO_MEM;
+	}
+	pool->size = size;
+	return ESP_OK;
+}
+
+void* capture_pool_alloc(CapturePool* pool, size_t bytes) {
+	const size_t aligned = (bytes + POOL_ALIGN - 1) & ~(POOL_ALIGN - 1);
+	if (aligned > pool->size - pool->used) {
+		return nullptr;
+	}
+	void* block = pool->base + pool->used;
+	pool->used += aligned;
+	return block;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// One block allocated at start that the capture path carves its large buffers from, so they can be
+// sized at runtime without fragmenting the heap Wi-Fi and TLS allocate from. It lives in PSRAM when
+// the module has it and otherwise in DMA-capable internal RAM. Nothing is ever freed back to it.
+struct CapturePool {
+	uint8_t* base;
+	size_t size;
+	size_t used;
+	bool external;
+};
+
+esp_err_t capture_pool_init(CapturePool* pool, size_t size);
+// Returns a 4-byte aligned block, or nullptr once the pool is exhausted.
+void* capture_pool_alloc(CapturePool* pool, size_t bytes);
@@ -0,0 +1,52 @@
+#include "capture_settings.h"
+
+#include "esp_log.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+
+static constexpr const char* NVS_NAMESPACE = "capture";
+static constexpr const char* KEY_WINDOW_MS = "window_ms";
+static constexpr const char* KEY_HOP_MS = "hop_ms";
+static const char* TAG = "capture_settings";
+
+void capture_settings_load(CaptureSettings* settings) {
+	*settings = {
+		.window_ms = CONFIG_MIC_UPLOAD_WINDOW_MS,
+#if CONFIG_MIC_UPLOAD_STREAMING
+		.hop_ms = 0,
+#else
+		.hop_ms = CONFIG_MIC_UPLOAD_HOP_MS,
+#endif
+	};
+	nvs_handle_t handle;
+	if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+		return;
+	}
+	uint32_t value = 0;
+	if (nvs_get_u32(handle, KEY_WINDOW_MS, &value) == ESP_OK && value > 0) {
+		settings->window_ms = value;
+	}
+	if (nvs_get_u32(handle, KEY_HOP_MS, &value) == ESP_OK) {
+		settings->hop_ms = value;
+	}
+	nvs_close(handle);
+}
+
+esp_err_t capture_settings_store(const CaptureSettings* settings) {
+	nvs_handle_t handle;
+	esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+	if (err == ESP_OK) {
+		err = nvs_set_u32(handle, KEY_WINDOW_MS, settings->window_ms);
+		if (err == ESP_OK) {
+			err = nvs_set_u32(handle, KEY_HOP_MS, settings->hop_ms);
+		}
+		if (err == ESP_OK) {
+			err = nvs_commit(handle);
+		}
+		nvs_close(handle);
+	}
+	if (err != ESP_OK) {
+		ESP_LOGW(TAG, "Failed to store capture settings: %s", esp_err_to_name(err));
+	}
+	return err;
+}
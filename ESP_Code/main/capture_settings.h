@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Capture parameters that can be tuned per site without rebuilding. They are kept in NVS, so they
+// survive reboots, and fall back to the Kconfig defaults until first set.
+struct CaptureSettings {
+	uint32_t window_ms;
+	uint32_t hop_ms;  // from one window's start to the next; 0 for back-to-back windows
+};
+
+void capture_settings_load(CaptureSettings* settings);
+esp_err_t capture_settings_store(const CaptureSettings* settings);
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed little-endian header in front of every upload body, live or spooled, so the server learns
+// the format and provenance of a clip from the clip itself. Mirrored by API/clip_header.py. Fields
+// are only ever appended; header_size tells a reader where the payload starts.
+static constexpr uint8_t CLIP_HEADER_MAGIC[4] = {'B', 'S', 'C', 'L'};
+static constexpr uint8_t CLIP_HEADER_VERSION = 1;
+// sample_count and the sample stats are final. Streamed bodies are sent before they are known.
+static constexpr uint16_t CLIP_FLAG_COMPLETE = 1 << 0;
+// The body is a ClipHeartbeat instead of audio; the header describes the last window held back.
+static constexpr uint16_t CLIP_FLAG_HEARTBEAT = 1 << 1;
+// The body is only the active span of its window, window_offset samples in. The sample stats
+// still describe the whole window.
+static constexpr uint16_t CLIP_FLAG_TRIMMED = 1 << 2;
+
+enum class ClipCodec : uint8_t {
+	Pcm16 = 0,
+	ImaAdpcm = 1,
+	Flac = 2,
+	LogMel = 3,
+};
+
+struct ClipHeader {
+	uint8_t magic[4];
+	uint8_t version;
+	ClipCodec codec;
+	uint16_t header_size;
+	uint8_t device_mac[6];
+	uint16_t flags;
+	// Wall-clock time of the first sample in microseconds since the Unix epoch, 0 before SNTP sync.
+	int64_t capture_start_us;
+	uint32_t sample_rate;
+	uint32_t sample_count;
+	uint32_t sequence;
+	int16_t min_sample;
+	int16_t max_sample;
+	uint32_t non_zero_samples;
+	// Samples were amplified by 2^gain_log2; divide by it to recover the mic's level.
+	uint8_t gain_log2;
+	uint8_t reserved[3];
+	// Position of the clip in the window it was cut from, in samples, and that window's length.
+	uint32_t window_offset;
+	uint32_t window_sample_count;
+	// Position of the clip's first sample in the node's sample stream, counted from 0 at boot.
+	// stream_id is random per boot, so positions only compare between clips with the same one.
+	uint64_t first_sample;
+	uint32_t stream_id;
+	// Distance from this window's start to the next one's; shorter than the window when they overlap.
+	uint32_t hop_samples;
+};
+
+static_assert(sizeof(ClipHeader) == 72, "ClipHeader layout is shared with the server");
+
+// Sent in place of windows the activity detector found silent, so the server knows the node is
+// alive and how much it did not hear.
+struct ClipHeartbeat {
+	uint32_t windows_suppressed;  // since the last heartbeat that reached the server
+	uint32_t samples_suppressed;
+};
+
+// Starts the body of a LogMel clip and is followed by one mel_bands-byte frame every hop_samples
+// samples. Feature value q is db_floor + q * db_step_q8 / 256 dB relative to a full-scale sine,
+// before the clip's gain_log2 is divided out.
+struct ClipLogMel {
+	uint16_t fft_size;
+	uint16_t hop_samples;
+	uint16_t fmin_hz;
+	uint16_t fmax_hz;
+	uint8_t mel_bands;
+	uint8_t reserved;
+	int16_t db_floor;
+	uint16_t db_step_q8;
+};
+
+static_assert(sizeof(ClipLogMel) == 14, "ClipLogMel layout is shared with the server");
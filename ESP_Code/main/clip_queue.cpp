@@ -0,0 +1,291 @@
+#include "clip_queue.h"
+
+#include <algorithm>
+#include <stddef.h>
+
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+
+static constexpr uint32_t RECORD_MAGIC = 0x51504C43;  // "CLPQ"
+static constexpr uint32_t STATE_PENDING = 0xFFFFFFFF;
+static constexpr uint32_t STATE_REPLAYED = 0;
+static constexpr size_t SECTOR_SIZE = 4096;
+static const char* TAG = "clip_queue";
+
+// Sits at the start of a record's first sector. state stays erased until the clip is replayed and
+// is then programmed to zero in place, so marking a clip done costs no erase.
+struct ClipRecordHeader {
+	uint32_t magic;
+	uint32_t sequence;
+	uint32_t length;
+	uint32_t payload_crc;
+	uint32_t header_crc;
+	uint32_t state;
+	uint32_t reserved[2];
+};
+
+static constexpr size_t HEADER_SIZE = sizeof(ClipRecordHeader);
+
+static size_t record_span(size_t length) {
+	return (HEADER_SIZE + length + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE;
+}
+
+static uint32_t header_crc(const ClipRecordHeader& header) {
+	return esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(&header), offsetof(ClipRecordHeader, header_crc));
+}
+
+static bool read_header(const ClipQueue* queue, size_t offset, ClipRecordHeader* header) {
+	if (esp_partition_read(queue->partition, offset, header, HEADER_SIZE) != ESP_OK) {
+		return false;
+	}
+	return header->magic == RECORD_MAGIC && header->header_crc == header_crc(*header) && record_span(header->length) < queue->size;
+}
+
+static esp_err_t read_wrapped(const ClipQueue* queue, size_t offset, uint8_t* data, size_t length) {
+	offset %= queue->size;
+	const size_t first = std::min(length, queue->size - offset);
+	esp_err_t err = esp_partition_read(queue->partition, offset, data, first);
+	if (err == ESP_OK && first < length) {
+		err = esp_partition_read(queue->partition, 0, data + first, length - first);
+	}
+	return err;
+}
+
+static esp_err_t write_wrapped(const ClipQueue* queue, size_t offset, const uint8_t* data, size_t length) {
+	offset %= queue->size;
+	const size_t first = std::min(length, queue->size - offset);
+	esp_err_t err = esp_partition_write(queue->partition, offset, data, first);
+	if (err == ESP_OK && first < length) {
+		err = esp_partition_write(queue->partition, 0, data + first, length - first);
+	}
+	return err;
+}
+
+// Advances the tail past the oldest clip. Called with the lock held.
+static void advance_tail(ClipQueue* queue, size_t span, size_t length) {
+	queue->tail = (queue->tail + span) % queue->size;
+	--queue->stats.clips_pending;
+	queue->stats.bytes_pending -= static_cast<uint32_t>(length);
+
+	ClipRecordHeader header = {};
+	if (queue->stats.clips_pending == 0) {
+		queue->tail = queue->head;
+		// A skipped clip with an unreadable header took its unknown length with it.
+		queue->stats.bytes_pending = 0;
+	} else if (read_header(queue, queue->tail, &header)) {
+		queue->tail_sequence = header.sequence;
+	}
+}
+
+// Skips the oldest clip when its header cannot be read. Its length is unknown, so the tail moves
+// sector by sector to the next readable header, or to the head, and the clip is counted once.
+// Called with the lock held.
+static void skip_unreadable_tail(ClipQueue* queue) {
+	size_t span = SECTOR_SIZE;
+	ClipRecordHeader header = {};
+	while (span < queue->size && (queue->tail + span) % queue->size != queue->head && !read_header(queue, (queue->tail + span) % queue->size, &header)) {
+		span += SECTOR_SIZE;
+	}
+	advance_tail(queue, span, 0);
+}
+
+// Makes room for the record being written by erasing sectors ahead of it, overwriting the oldest
+// clip when the log runs into it. Called with the lock held.
+static esp_err_t erase_for_write(ClipQueue* queue, size_t needed) {
+	if (needed + SECTOR_SIZE > queue->size) {
+		return ESP_ERR_NO_MEM;
+	}
+	while (queue->write_erased < needed) {
+		const size_t sector = (queue->head + queue->write_erased) % queue->size;
+		if (queue->stats.clips_pending > 0 && sector == queue->tail) {
+			ClipRecordHeader header = {};
+			if (read_header(queue, queue->tail, &header)) {
+				ESP_LOGW(TAG, "Queue full, overwriting clip %u", static_cast<unsigned>(header.sequence));
+				advance_tail(queue, record_span(header.length), header.length);
+			} else {
+				ESP_LOGW(TAG, "Queue full, overwriting clip with unreadable header at 0x%x", static_cast<unsigned>(queue->tail));
+				skip_unreadable_tail(queue);
+			}
+			++queue->stats.clips_overwritten;
+		}
+		esp_err_t err = esp_partition_erase_range(queue->partition, sector, SECTOR_SIZE);
+		if (err != ESP_OK) {
+			return err;
+		}
+		queue->write_erased += SECTOR_SIZE;
+	}
+	return ESP_OK;
+}
+
+esp_err_t clip_queue_init(ClipQueue* queue, const char* partition_label) {
+	if (queue == nullptr || partition_label == nullptr) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	*queue = {};
+	queue->partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partition_label);
+	if (queue->partition == nullptr) {
+		ESP_LOGE(TAG, "Partition \"%s\" not found", partition_label);
+		return ESP_ERR_NOT_FOUND;
+	}
+	queue->size = queue->partition->size / SECTOR_SIZE * SECTOR_SIZE;
+	if (queue->partition->erase_size != SECTOR_SIZE || queue->size < 2 * SECTOR_SIZE) {
+		ESP_LOGE(TAG, "Partition \"%s\" is not usable as a clip queue", partition_label);
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	queue->lock = xSemaphoreCreateMutex();
+	if (queue->lock == nullptr) {
+		return ESP_ERR_NO_MEM;
+	}
+
+	// Recover from the sector headers: head follows the newest record, tail is the oldest pending.
+	bool found = false;
+	uint32_t newest_sequence = 0;
+	for (size_t offset = 0; offset < queue->size; offset += SECTOR_SIZE) {
+		ClipRecordHeader header = {};
+		if (!read_header(queue, offset, &header)) {
+			continue;
+		}
+		if (!found || header.sequence > newest_sequence) {
+			newest_sequence = header.sequence;
+			queue->head = (offset + record_span(header.length)) % queue->size;
+		}
+		if (header.state == STATE_PENDING) {
+			if (queue->stats.clips_pending == 0 || header.sequence < queue->tail_sequence) {
+				queue->tail = offset;
+				queue->tail_sequence = header.sequence;
+			}
+			++queue->stats.clips_pending;
+			queue->stats.bytes_pending += header.length;
+		}
+		found = true;
+	}
+	queue->next_sequence = found ? newest_sequence + 1 : 1;
+	if (queue->stats.clips_pending == 0) {
+		queue->tail = queue->head;
+	}
+
+	ESP_LOGI(
+		TAG,
+		"Clip queue \"%s\": %u bytes, %u clips (%u bytes) pending",
+		partition_label,
+		static_cast<unsigned>(queue->size),
+		static_cast<unsigned>(queue->stats.clips_pending),
+		static_cast<unsigned>(queue->stats.bytes_pending)
+	);
+	return ESP_OK;
+}
+
+esp_err_t clip_queue_begin(ClipQueue* queue) {
+	xSemaphoreTake(queue->lock, portMAX_DELAY);
+	queue->writing = true;
+	queue->write_length = 0;
+	queue->write_erased = 0;
+	queue->write_crc = 0;
+	xSemaphoreGive(queue->lock);
+	return ESP_OK;
+}
+
+esp_err_t clip_queue_append(ClipQueue* queue, const uint8_t* data, size_t length) {
+	xSemaphoreTake(queue->lock, portMAX_DELAY);
+	esp_err_t err = queue->writing ? erase_for_write(queue, HEADER_SIZE + queue->write_length + length) : ESP_ERR_INVALID_STATE;
+	if (err == ESP_OK) {
+		err = write_wrapped(queue, queue->head + HEADER_SIZE + queue->write_length, data, length);
+	}
+	if (err == ESP_OK) {
+		queue->write_crc = esp_rom_crc32_le(queue->write_crc, data, length);
+		queue->write_length += length;
+	}
+	xSemaphoreGive(queue->lock);
+	return err;
+}
+
+esp_err_t clip_queue_commit(ClipQueue* queue) {
+	xSemaphoreTake(queue->lock, portMAX_DELAY);
+	esp_err_t err = queue->writing ? erase_for_write(queue, HEADER_SIZE + queue->write_length) : ESP_ERR_INVALID_STATE;
+
+	ClipRecordHeader header = {};
+	header.magic = RECORD_MAGIC;
+	header.sequence = queue->next_sequence;
+	header.length = static_cast<uint32_t>(queue->write_length);
+	header.payload_crc = queue->write_crc;
+	header.header_crc = header_crc(header);
+	header.state = STATE_PENDING;
+	header.reserved[0] = 0xFFFFFFFF;
+	header.reserved[1] = 0xFFFFFFFF;
+	if (err == ESP_OK) {
+		err = esp_partition_write(queue->partition, queue->head, &header, HEADER_SIZE);
+	}
+
+	if (err == ESP_OK) {
+		if (queue->stats.clips_pending == 0) {
+			queue->tail = queue->head;
+			queue->tail_sequence = header.sequence;
+		}
+		queue->head = (queue->head + record_span(queue->write_length)) % queue->size;
+		++queue->next_sequence;
+		++queue->stats.clips_pending;
+		++queue->stats.clips_stored;
+		queue->stats.bytes_pending += header.length;
+	}
+	queue->writing = false;
+	xSemaphoreGive(queue->lock);
+	return err;
+}
+
+void clip_queue_abort(ClipQueue* queue) {
+	xSemaphoreTake(queue->lock, portMAX_DELAY);
+	queue->writing = false;
+	xSemaphoreGive(queue->lock);
+}
+
+bool clip_queue_peek(ClipQueue* queue, ClipInfo* clip) {
+	xSemaphoreTake(queue->lock, portMAX_DELAY);
+	bool found = false;
+	while (queue->stats.clips_pending > 0 && !found) {
+		ClipRecordHeader header = {};
+		if (read_header(queue, queue->tail, &header)) {
+			clip->sequence = header.sequence;
+			clip->offset = queue->tail;
+			clip->length = header.length;
+			clip->crc = header.payload_crc;
+			found = true;
+		} else {
+			ESP_LOGE(TAG, "Unreadable clip header at 0x%x, skipping", static_cast<unsigned>(queue->tail));
+			skip_unreadable_tail(queue);
+		}
+	}
+	xSemaphoreGive(queue->lock);
+	return found;
+}
+
+esp_err_t clip_queue_read(ClipQueue* queue, const ClipInfo* clip, size_t offset, uint8_t* data, size_t length) {
+	if (offset + length > clip->length) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	xSemaphoreTake(queue->lock, portMAX_DELAY);
+	esp_err_t err = ESP_ERR_INVALID_STATE;
+	if (queue->stats.clips_pending > 0 && queue->tail == clip->offset && queue->tail_sequence == clip->sequence) {
+		err = read_wrapped(queue, clip->offset + HEADER_SIZE + offset, data, length);
+	}
+	xSemaphoreGive(queue->lock);
+	return err;
+}
+
+void clip_queue_pop(ClipQueue* queue, const ClipInfo* clip) {
+	xSemaphoreTake(queue->lock, portMAX_DELAY);
+	if (queue->stats.clips_pending > 0 && queue->tail == clip->offset && queue->tail_sequence == clip->sequence) {
+		const uint32_t replayed = STATE_REPLAYED;
+		ESP_ERROR_CHECK_WITHOUT_ABORT(esp_partition_write(queue->partition, clip->offset + offsetof(ClipRecordHeader, state), &replayed, sizeof(replayed)));
+		advance_tail(queue, record_span(clip->length), clip->length);
+		++queue->stats.clips_replayed;
+	}
+	xSemaphoreGive(queue->lock);
+}
+
+void clip_queue_get_stats(ClipQueue* queue, ClipQueueStats* stats) {
+	xSemaphoreTake(queue->lock, portMAX_DELAY);
+	*stats = queue->stats;
+	xSemaphoreGive(queue->lock);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+struct ClipQueueStats {
+	uint32_t clips_pending;
+	uint32_t bytes_pending;
+	uint32_t clips_stored;
+	uint32_t clips_replayed;
+	uint32_t clips_overwritten;
+};
+
+// Oldest pending clip, as returned by clip_queue_peek.
+struct ClipInfo {
+	uint32_t sequence;
+	size_t offset;
+	size_t length;
+	uint32_t crc;
+};
+
+// Persistent FIFO of upload bodies in a raw data partition. Records are appended to a circular log
+// on sector boundaries, so every sector is erased equally often, and once the log is full the
+// oldest clip is overwritten. A record's header is written last: a clip cut off by a reset has
+// none and is skipped on the next boot. One writer and one reader may use the queue concurrently.
+struct ClipQueue {
+	const esp_partition_t* partition;
+	SemaphoreHandle_t lock;
+	size_t size;
+	size_t head;
+	size_t tail;
+	uint32_t tail_sequence;
+	uint32_t next_sequence;
+	bool writing;
+	size_t write_length;
+	size_t write_erased;
+	uint32_t write_crc;
+	ClipQueueStats stats;
+};
+
+// Finds the partition by label and recovers the pending clips left in it.
+esp_err_t clip_queue_init(ClipQueue* queue, const char* partition_label);
+
+// Writer side: a clip is appended piecewise and only becomes visible once committed.
+esp_err_t clip_queue_begin(ClipQueue* queue);
+esp_err_t clip_queue_append(ClipQueue* queue, const uint8_t* data, size_t length);
+esp_err_t clip_queue_commit(ClipQueue* queue);
+void clip_queue_abort(ClipQueue* queue);
+
+// Reader side. Reads fail with ESP_ERR_INVALID_STATE once the writer has overwritten the clip.
+bool clip_queue_peek(ClipQueue* queue, ClipInfo* clip);
+esp_err_t clip_queue_read(ClipQueue* queue, const ClipInfo* clip, size_t offset, uint8_t* data, size_t length);
+void clip_queue_pop(ClipQueue* queue, const ClipInfo* clip);
+
+void clip_queue_get_stats(ClipQueue* queue, ClipQueueStats* stats);
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+
+// One-pole DC-blocking high-pass: a leaky integrator tracks the DC level and is subtracted from
+// each sample, H(z) = (1 - z^-1) / (1 - (1 - 2^-shift) z^-1). The cutoff is about
+// sample_rate / (2 * pi * 2^shift). Integer only and a few cycles per sample, so it runs inline in
+// the capture loop; state carries across calls, chunks and windows. Samples are up to 24 bits, so
+// the offset is removed at the mic's full resolution, before any gain is applied.
+struct DcBlocker {
+	static constexpr int FRACTION_BITS = 4;
+
+	int32_t level;  // DC estimate in Q4
+	uint8_t shift;
+	bool primed;
+};
+
+inline void dc_blocker_init(DcBlocker* blocker, uint8_t shift) {
+	blocker->level = 0;
+	blocker->shift = shift;
+	blocker->primed = false;
+}
+
+// Smallest shift whose cutoff is at or below cutoff_hz.
+constexpr uint8_t dc_blocker_shift_for_cutoff(int sample_rate_hz, int cutoff_hz) {
+	uint8_t shift = 1;
+	while (shift < 20 && static_cast<int64_t>(cutoff_hz) * 2 * 314 * (int64_t{1} << shift) < static_cast<int64_t>(sample_rate_hz) * 100) {
+		++shift;
+	}
+	return shift;
+}
+
+// Current DC estimate in sample units.
+inline int32_t dc_blocker_offset(const DcBlocker* blocker) {
+	return (blocker->level + (1 << (DcBlocker::FRACTION_BITS - 1))) >> DcBlocker::FRACTION_BITS;
+}
+
+// Returns the sample less the DC estimate; the result needs one bit more than the input.
+inline int32_t dc_blocker_process(DcBlocker* blocker, int32_t sample) {
+	const int32_t input = sample << DcBlocker::FRACTION_BITS;
+	if (!blocker->primed) {
+		// Start from the first sample so the mic's offset does not ring through the first window.
+		blocker->level = input;
+		blocker->primed = true;
+	}
+	blocker->level += (input - blocker->level) >> blocker->shift;
+	return sample - dc_blocker_offset(blocker);
+}
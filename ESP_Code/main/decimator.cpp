@@ -0,0 +1,157 @@
+#include "decimator.h"
+
+#include <limits>
+
+// Windowed-sinc (Blackman) low-pass prototypes in Q15, cutoff at 0.45 of the output rate and
+// normalised to unity DC gain. Every table is symmetric, which process() relies on.
+static const int16_t TAPS_2_FAST[] = {
+	0, 6, 146, 37, -1142, -1006, 5036, 13307, 13307, 5036, -1006, -1142,
+	37, 146, 6, 0,
+};
+
+static const int16_t TAPS_2_SHARP[] = {
+	0, 3, 3, -29, -34, 91, 155, -172, -470, 178, 1118, 128,
+	-2352, -1436, 5708, 13493, 13493, 5708, -1436, -2352, 128, 1118, 178, -470,
+	-172, 155, 91, -34, -29, 3, 3, 0,
+};
+
+static const int16_t TAPS_3_FAST[] = {
+	0, -3, 15, 89, 141, -61, -633, -1085, -318, 2431, 6410, 9398,
+	9398, 6410, 2431, -318, -1085, -633, -61, 141, 89, 15, -3, 0,
+};
+
+static const int16_t TAPS_3_SHARP[] = {
+	0, 1, 3, 4, -7, -26, -29, 10, 82, 116, 28, -172,
+	-320, -193, 250, 702, 645, -183, -1350, -1778, -426, 2818, 6756, 9453,
+	9453, 6756, 2818, -426, -1778, -1350, -183, 645, 702, 250, -193, -320,
+	-172, 28, 116, 82, 10, -29, -26, -7, 4, 3, 1, 0,
+};
+
+static const int16_t TAPS_4_FAST[] = {
+	0, -2, -1, 17, 62, 109, 85, -89, -423, -758, -761, -64,
+	1497, 3681, 5841, 7190, 7190, 5841, 3681, 1497, -64, -761, -758, -423,
+	-89, 85, 109, 62, 17, -1, -2, 0,
+};
+
+static const int16_t TAPS_4_SHARP[] = {
+	0, 0, 1, 3, 3, -1, -11, -22, -24, -8, 27, 69,
+	90, 60, -30, -151, -237, -214, -42, 239, 500, 568, 316, -247,
+	-916, -1339, -1137, -84, 1755, 3989, 6012, 7215, 7215, 6012, 3989, 1755,
+	-84, -1137, -1339, -916, -247, 316, 568, 500, 239, -42, -214, -237,
+	-151, -30, 60, 90, 69, 27, -8, -24, -22, -11, -1, 3,
+	3, 1, 0, 0,
+};
+
+static const int16_t TAPS_6_FAST[] = {
+	0, -1, -2, -2, 4, 17, 38, 63, 78, 68, 14, -93,
+	-246, -413, -536, -540, -349, 92, 792, 1701, 2715, 3681, 4442, 4861,
+	4861, 4442, 3681, 2715, 1701, 792, 92, -349, -540, -536, -413, -246,
+	-93, 14, 68, 78, 63, 38, 17, 4, -2, -2, -1, 0,
+};
+
+static const int16_t TAPS_6_SHARP[] = {
+	0, 0, 0, 1, 2, 2, 2, 1, -2, -6, -12, -16,
+	-17, -13, -2, 14, 34, 51, 61, 56, 33, -8, -61, -115,
+	-154, -164, -132, -54, 61, 194, 312, 381, 369, 256, 43, -240,
+	-542, -791, -907, -819, -481, 117, 938, 1906, 2907, 3812, 4498, 4869,
+	4869, 4498, 3812, 2907, 1906, 938, 117, -481, -819, -907, -791, -542,
+	-240, 43, 256, 369, 381, 312, 194, 61, -54, -132, -164, -154,
+	-115, -61, -8, 33, 56, 61, 51, 34, 14, -2, -13, -17,
+	-16, -12, -6, -2, 1, 2, 2, 2, 1, 0, 0, 0,
+};
+
+static const int16_t* select_taps(size_t factor, DecimatorFilter filter, size_t* tap_count) {
+	const bool sharp = filter == DecimatorFilter::Sharp;
+	switch (factor) {
+	case 2:
+		*tap_count = sharp ? sizeof(TAPS_2_SHARP) / sizeof(int16_t) : sizeof(TAPS_2_FAST) / sizeof(int16_t);
+		return sharp ? TAPS_2_SHARP : TAPS_2_FAST;
+	case 3:
+		*tap_count = sharp ? sizeof(TAPS_3_SHARP) / sizeof(int16_t) : sizeof(TAPS_3_FAST) / sizeof(int16_t);
+		return sharp ? TAPS_3_SHARP : TAPS_3_FAST;
+	case 4:
+		*tap_count = sharp ? sizeof(TAPS_4_SHARP) / sizeof(int16_t) : sizeof(TAPS_4_FAST) / sizeof(int16_t);
+		return sharp ? TAPS_4_SHARP : TAPS_4_FAST;
+	case 6:
+		*tap_count = sharp ? sizeof(TAPS_6_SHARP) / sizeof(int16_t) : sizeof(TAPS_6_FAST) / sizeof(int16_t);
+		return sharp ? TAPS_6_SHARP : TAPS_6_FAST;
+	default:
+		*tap_count = 0;
+		return nullptr;
+	}
+}
+
+esp_err_t decimator_init(Decimator* decimator, size_t factor, DecimatorFilter filter) {
+	if (decimator == nullptr) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	size_t tap_count = 0;
+	const int16_t* taps = select_taps(factor, filter, &tap_count);
+	if (taps == nullptr || tap_count > Decimator::MAX_TAPS) {
+		return ESP_ERR_NOT_SUPPORTED;
+	}
+
+	decimator->taps = taps;
+	decimator->tap_count = tap_count;
+	decimator->factor = factor;
+	decimator_reset(decimator);
+	return ESP_OK;
+}
+
+void decimator_reset(Decimator* decimator) {
+	decimator->phase = 0;
+	decimator->history_pos = 0;
+	for (int16_t& sample : decimator->history) {
+		sample = 0;
+	}
+}
+
+size_t decimator_input_for_output(const Decimator* decimator, size_t output_count) {
+	if (output_count == 0) {
+		return 0;
+	}
+	return output_count * decimator->factor - decimator->phase;
+}
+
+size_t decimator_process(Decimator* decimator, const int16_t* input, size_t input_count, int16_t* output, size_t output_capacity) {
+	const size_t tap_count = decimator->tap_count;
+	const int16_t* taps = decimator->taps;
+	size_t produced = 0;
+
+	for (size_t input_index = 0; input_index < input_count; ++input_index) {
+		// The delay line is written twice, tap_count apart, so the newest tap_count samples are
+		// always contiguous at history[history_pos .. history_pos + tap_count).
+		const int16_t sample = input[input_index];
+		decimator->history[decimator->history_pos] = sample;
+		decimator->history[decimator->history_pos + tap_count] = sample;
+		if (++decimator->history_pos == tap_count) {
+			decimator->history_pos = 0;
+		}
+
+		if (++decimator->phase < decimator->factor) {
+			continue;
+		}
+		decimator->phase = 0;
+
+		if (produced < output_capacity) {
+			// Taps are symmetric, so oldest-to-newest order needs no reversal. The absolute tap sum
+			// stays below 1.6 in Q15, which keeps the accumulator inside int32 for any int16 input.
+			const int16_t* window = decimator->history + decimator->history_pos;
+			int32_t accumulator = 1 << 14;
+			for (size_t tap_index = 0; tap_index < tap_count; ++tap_index) {
+				accumulator += static_cast<int32_t>(taps[tap_index]) * window[tap_index];
+			}
+			int32_t filtered = accumulator >> 15;
+			if (filtered > std::numeric_limits<int16_t>::max()) {
+				filtered = std::numeric_limits<int16_t>::max();
+			} else if (filtered < std::numeric_limits<int16_t>::min()) {
+				filtered = std::numeric_limits<int16_t>::min();
+			}
+			output[produced] = static_cast<int16_t>(filtered);
+		}
+		++produced;
+	}
+
+	return produced;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+enum class DecimatorFilter : uint8_t {
+	Fast,   // 8 taps per phase: cheapest, wider transition band
+	Sharp,  // 16 taps per phase: steeper anti-alias rolloff
+};
+
+// Fixed-point FIR decimator for integer ratios 2, 3, 4 and 6. The anti-alias filter is only
+// evaluated at output instants, so it costs taps-per-phase multiply-adds per input sample and
+// needs no FPU. State carries across calls, so input can be fed in arbitrary chunk sizes.
+struct Decimator {
+	static constexpr size_t MAX_TAPS = 6 * 16;
+
+	const int16_t* taps;
+	size_t tap_count;
+	size_t factor;
+	size_t phase;
+	size_t history_pos;
+	int16_t history[2 * MAX_TAPS];
+};
+
+esp_err_t decimator_init(Decimator* decimator, size_t factor, DecimatorFilter filter);
+void decimator_reset(Decimator* decimator);
+
+// Number of input samples needed to produce the next output_count outputs.
+size_t decimator_input_for_output(const Decimator* decimator, size_t output_count);
+
+// Consumes input_count samples and returns how many outputs they produced. At most output_capacity
+// of those are written; the rest are discarded, but the filter state still advances past them.
+size_t decimator_process(Decimator* decimator, const int16_t* input, size_t input_count, int16_t* output, size_t output_capacity);
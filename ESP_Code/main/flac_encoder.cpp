@@ -0,0 +1,342 @@
+#include "flac_encoder.h"
+
+#include <algorithm>
+#include <array>
+
+static constexpr uint32_t BITS_PER_SAMPLE = 16;
+static constexpr uint32_t MAX_FIXED_ORDER = 4;
+static constexpr uint32_t MAX_PARTITION_ORDER = 6;
+// Parameter 15 is the escape code with 4-bit parameters, so Rice parameters stop at 14.
+static constexpr uint32_t MAX_RICE_PARAMETER = 14;
+
+static constexpr std::array<uint8_t, 256> make_crc8_table() {
+	std::array<uint8_t, 256> table = {};
+	for (uint32_t byte = 0; byte < 256; ++byte) {
+		uint32_t crc = byte;
+		for (int bit = 0; bit < 8; ++bit) {
+			crc = (crc & 0x80) != 0 ? (crc << 1) ^ 0x07 : crc << 1;
+		}
+		table[byte] = static_cast<uint8_t>(crc);
+	}
+	return table;
+}
+
+static constexpr std::array<uint16_t, 256> make_crc16_table() {
+	std::array<uint16_t, 256> table = {};
+	for (uint32_t byte = 0; byte < 256; ++byte) {
+		uint32_t crc = byte << 8;
+		for (int bit = 0; bit < 8; ++bit) {
+			crc = (crc & 0x8000) != 0 ? (crc << 1) ^ 0x8005 : crc << 1;
+		}
+		table[byte] = static_cast<uint16_t>(crc);
+	}
+	return table;
+}
+
+static constexpr std::array<uint8_t, 256> CRC8_TABLE = make_crc8_table();
+static constexpr std::array<uint16_t, 256> CRC16_TABLE = make_crc16_table();
+
+// MSB-first bit packer over a bounded buffer. Writing past the limit sets overflow instead.
+struct BitWriter {
+	uint8_t* data;
+	size_t limit;
+	size_t position;
+	uint32_t accumulator;
+	uint32_t pending_bits;
+	bool overflow;
+};
+
+static void bit_writer_put(BitWriter* writer, uint32_t value, uint32_t bit_count) {
+	// bit_count <= 24 keeps the accumulator within 32 bits.
+	writer->accumulator = (writer->accumulator << bit_count) | (value & ((1u << bit_count) - 1));
+	writer->pending_bits += bit_count;
+	while (writer->pending_bits >= 8) {
+		writer->pending_bits -= 8;
+		if (writer->position < writer->limit) {
+			writer->data[writer->position++] = static_cast<uint8_t>(writer->accumulator >> writer->pending_bits);
+		} else {
+			writer->overflow = true;
+		}
+	}
+}
+
+static void bit_writer_align(BitWriter* writer) {
+	if (writer->pending_bits > 0) {
+		bit_writer_put(writer, 0, 8 - writer->pending_bits);
+	}
+}
+
+static void bit_writer_put_rice(BitWriter* writer, int32_t residual, uint32_t parameter) {
+	const uint32_t folded = (static_cast<uint32_t>(residual) << 1) ^ static_cast<uint32_t>(residual >> 31);
+	uint32_t quotient = folded >> parameter;
+	while (quotient > 16 && !writer->overflow) {
+		bit_writer_put(writer, 0, 16);
+		quotient -= 16;
+	}
+	bit_writer_put(writer, 0, quotient);
+	bit_writer_put(writer, (1u << parameter) | (folded & ((1u << parameter) - 1)), parameter + 1);
+}
+
+static void put_utf8_number(BitWriter* writer, uint32_t value) {
+	if (value < 0x80) {
+		bit_writer_put(writer, value, 8);
+		return;
+	}
+	uint32_t byte_count = 2;
+	while (byte_count < 6 && value >= (1u << (5 * byte_count + 1))) {
+		++byte_count;
+	}
+	const uint32_t prefix = (0xFFu << (8 - byte_count)) & 0xFF;
+	bit_writer_put(writer, prefix | (value >> (6 * (byte_count - 1))), 8);
+	for (uint32_t index = byte_count - 1; index > 0; --index) {
+		bit_writer_put(writer, 0x80 | ((value >> (6 * (index - 1))) & 0x3F), 8);
+	}
+}
+
+static uint32_t sample_rate_code(uint32_t sample_rate, uint32_t* extra_bits) {
+	*extra_bits = 0;
+	switch (sample_rate) {
+		case 8000: return 0x4;
+		case 16000: return 0x5;
+		case 22050: return 0x6;
+		case 24000: return 0x7;
+		case 32000: return 0x8;
+		case 44100: return 0x9;
+		case 48000: return 0xA;
+		default: break;
+	}
+	if (sample_rate <= 0xFFFF) {
+		*extra_bits = 16;
+		return 0xD;
+	}
+	return 0x0;
+}
+
+// Picks the fixed predictor with the smallest total absolute residual, as libFLAC does.
+static uint32_t best_fixed_order(const int16_t* samples, size_t sample_count) {
+	if (sample_count <= MAX_FIXED_ORDER) {
+		return 0;
+	}
+
+	std::array<uint32_t, MAX_FIXED_ORDER + 1> totals = {};
+	int32_t previous0 = samples[3];
+	int32_t previous1 = samples[3] - samples[2];
+	int32_t previous2 = previous1 - (samples[2] - samples[1]);
+	int32_t previous3 = previous2 - ((samples[2] - samples[1]) - (samples[1] - samples[0]));
+	for (size_t index = MAX_FIXED_ORDER; index < sample_count; ++index) {
+		const int32_t error0 = samples[index];
+		const int32_t error1 = error0 - previous0;
+		const int32_t error2 = error1 - previous1;
+		const int32_t error3 = error2 - previous2;
+		const int32_t error4 = error3 - previous3;
+		totals[0] += static_cast<uint32_t>(error0 < 0 ? -error0 : error0);
+		totals[1] += static_cast<uint32_t>(error1 < 0 ? -error1 : error1);
+		totals[2] += static_cast<uint32_t>(error2 < 0 ? -error2 : error2);
+		totals[3] += static_cast<uint32_t>(error3 < 0 ? -error3 : error3);
+		totals[4] += static_cast<uint32_t>(error4 < 0 ? -error4 : error4);
+		previous0 = error0;
+		previous1 = error1;
+		previous2 = error2;
+		previous3 = error3;
+	}
+	return static_cast<uint32_t>(std::min_element(totals.begin(), totals.end()) - totals.begin());
+}
+
+static void compute_fixed_residual(const int16_t* x, size_t sample_count, uint32_t order, int32_t* residual) {
+	for (size_t i = order; i < sample_count; ++i) {
+		switch (order) {
+			case 0: residual[i] = x[i]; break;
+			case 1: residual[i] = x[i] - x[i - 1]; break;
+			case 2: residual[i] = x[i] - 2 * x[i - 1] + x[i - 2]; break;
+			case 3: residual[i] = x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3]; break;
+			default: residual[i] = x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4]; break;
+		}
+	}
+}
+
+static uint32_t rice_parameter(uint32_t folded_sum, uint32_t count) {
+	uint32_t parameter = 0;
+	while (parameter < MAX_RICE_PARAMETER && (static_cast<uint64_t>(count) << (parameter + 1)) < folded_sum) {
+		++parameter;
+	}
+	return parameter;
+}
+
+static uint32_t rice_bits_estimate(uint32_t folded_sum, uint32_t count, uint32_t parameter) {
+	return 4 + count * (parameter + 1) + (folded_sum >> parameter);
+}
+
+// Writes the residual section, choosing the partition order with the fewest estimated bits.
+static void put_residual(BitWriter* writer, const int32_t* residual, size_t sample_count, uint32_t predictor_order) {
+	uint32_t max_order = 0;
+	while (max_order < MAX_PARTITION_ORDER && (sample_count % (2u << max_order)) == 0 && (sample_count >> (max_order + 1)) > predictor_order) {
+		++max_order;
+	}
+
+	// Folded residual sums of the finest partitions; coarser orders merge neighbours.
+	std::array<uint32_t, 1u << MAX_PARTITION_ORDER> sums = {};
+	const size_t finest_size = sample_count >> max_order;
+	for (size_t partition = 0; partition < (1u << max_order); ++partition) {
+		const size_t start = partition == 0 ? predictor_order : partition * finest_size;
+		uint32_t sum = 0;
+		for (size_t index = start; index < (partition + 1) * finest_size; ++index) {
+			sum += (static_cast<uint32_t>(residual[index]) << 1) ^ static_cast<uint32_t>(residual[index] >> 31);
+		}
+		sums[partition] = sum;
+	}
+
+	uint32_t best_order = max_order;
+	uint32_t best_bits = UINT32_MAX;
+	std::array<uint32_t, 1u << MAX_PARTITION_ORDER> level_sums = sums;
+	for (uint32_t order = max_order + 1; order-- > 0;) {
+		const uint32_t partitions = 1u << order;
+		const uint32_t partition_size = static_cast<uint32_t>(sample_count >> order);
+		uint32_t bits = 0;
+		for (uint32_t partition = 0; partition < partitions; ++partition) {
+			const uint32_t count = partition_size - (partition == 0 ? predictor_order : 0);
+			bits += rice_bits_estimate(level_sums[partition], count, rice_parameter(level_sums[partition], count));
+		}
+		if (bits < best_bits) {
+			best_bits = bits;
+			best_order = order;
+		}
+		for (uint32_t partition = 0; partition < partitions / 2; ++partition) {
+			level_sums[partition] = level_sums[2 * partition] + level_sums[2 * partition + 1];
+		}
+	}
+
+	// Recompute the chosen order's sums from the finest level.
+	const uint32_t partitions = 1u << best_order;
+	const uint32_t merge = 1u << (max_order - best_order);
+	const size_t partition_size = sample_count >> best_order;
+	bit_writer_put(writer, 0, 2);
+	bit_writer_put(writer, best_order, 4);
+	for (uint32_t partition = 0; partition < partitions; ++partition) {
+		uint32_t sum = 0;
+		for (uint32_t index = 0; index < merge; ++index) {
+			sum += sums[partition * merge + index];
+		}
+		const size_t start = partition == 0 ? predictor_order : partition * partition_size;
+		const size_t end = (partition + 1) * partition_size;
+		const uint32_t parameter = rice_parameter(sum, static_cast<uint32_t>(end - start));
+		bit_writer_put(writer, parameter, 4);
+		for (size_t index = start; index < end && !writer->overflow; ++index) {
+			bit_writer_put_rice(writer, residual[index], parameter);
+		}
+	}
+}
+
+static esp_err_t emit_frame(FlacEncoder* encoder, FlacOutputFn output, void* user_ctx) {
+	const size_t sample_count = encoder->block_fill;
+	BitWriter writer = {};
+	writer.data = encoder->frame;
+	writer.limit = sizeof(encoder->frame);
+
+	// Frame header: sync, fixed block size, block size and rate codes, mono, 16-bit.
+	uint32_t rate_extra_bits = 0;
+	const uint32_t rate_code = sample_rate_code(encoder->sample_rate, &rate_extra_bits);
+	const bool full_block = sample_count == FLAC_BLOCK_SIZE;
+	bit_writer_put(&writer, 0xFFF8, 16);
+	bit_writer_put(&writer, full_block ? 0xA : 0x7, 4);
+	bit_writer_put(&writer, rate_code, 4);
+	bit_writer_put(&writer, 0x0, 4);
+	bit_writer_put(&writer, 0x4, 3);
+	bit_writer_put(&writer, 0, 1);
+	put_utf8_number(&writer, encoder->frame_number);
+	if (!full_block) {
+		bit_writer_put(&writer, static_cast<uint32_t>(sample_count - 1), 16);
+	}
+	if (rate_extra_bits > 0) {
+		bit_writer_put(&writer, encoder->sample_rate, rate_extra_bits);
+	}
+	uint8_t crc8 = 0;
+	for (size_t index = 0; index < writer.position; ++index) {
+		crc8 = CRC8_TABLE[crc8 ^ encoder->frame[index]];
+	}
+	bit_writer_put(&writer, crc8, 8);
+
+	// Fixed-predictor subframe, abandoned for a verbatim one if it would not be smaller.
+	const size_t subframe_start = writer.position;
+	const size_t verbatim_bytes = 1 + sample_count * sizeof(int16_t);
+	const uint32_t order = best_fixed_order(encoder->block, sample_count);
+	compute_fixed_residual(encoder->block, sample_count, order, encoder->residual);
+	writer.limit = subframe_start + verbatim_bytes;
+	bit_writer_put(&writer, 0x10 | (order << 1), 8);
+	for (uint32_t index = 0; index < order; ++index) {
+		bit_writer_put(&writer, static_cast<uint16_t>(encoder->block[index]), BITS_PER_SAMPLE);
+	}
+	put_residual(&writer, encoder->residual, sample_count, order);
+	bit_writer_align(&writer);
+	if (writer.overflow) {
+		writer.position = subframe_start;
+		writer.accumulator = 0;
+		writer.pending_bits = 0;
+		writer.overflow = false;
+		bit_writer_put(&writer, 0x02, 8);
+		for (size_t index = 0; index < sample_count; ++index) {
+			bit_writer_put(&writer, static_cast<uint16_t>(encoder->block[index]), BITS_PER_SAMPLE);
+		}
+	}
+	writer.limit = sizeof(encoder->frame);
+
+	uint16_t crc16 = 0;
+	for (size_t index = 0; index < writer.position; ++index) {
+		crc16 = static_cast<uint16_t>((crc16 << 8) ^ CRC16_TABLE[(crc16 >> 8) ^ encoder->frame[index]]);
+	}
+	bit_writer_put(&writer, crc16, 16);
+
+	++encoder->frame_number;
+	encoder->block_fill = 0;
+	return output(encoder->frame, writer.position, user_ctx);
+}
+
+esp_err_t flac_encoder_begin(FlacEncoder* encoder, uint32_t sample_rate, uint64_t total_samples, FlacOutputFn output, void* user_ctx) {
+	if (encoder == nullptr || output == nullptr || sample_rate == 0 || sample_rate > 0xFFFFF) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	encoder->sample_rate = sample_rate;
+	encoder->frame_number = 0;
+	encoder->block_fill = 0;
+
+	// "fLaC", then the only metadata block: STREAMINFO with unknown frame sizes and MD5.
+	std::array<uint8_t, FLAC_STREAM_HEADER_BYTES> header = {'f', 'L', 'a', 'C', 0x80, 0x00, 0x00, 34};
+	BitWriter writer = {};
+	writer.data = header.data();
+	writer.limit = header.size();
+	writer.position = 8;
+	bit_writer_put(&writer, FLAC_BLOCK_SIZE, 16);
+	bit_writer_put(&writer, FLAC_BLOCK_SIZE, 16);
+	bit_writer_put(&writer, 0, 24);
+	bit_writer_put(&writer, 0, 24);
+	bit_writer_put(&writer, sample_rate, 20);
+	bit_writer_put(&writer, 0, 3);
+	bit_writer_put(&writer, BITS_PER_SAMPLE - 1, 5);
+	bit_writer_put(&writer, static_cast<uint32_t>(total_samples >> 32) & 0xF, 4);
+	bit_writer_put(&writer, static_cast<uint32_t>(total_samples >> 16) & 0xFFFF, 16);
+	bit_writer_put(&writer, static_cast<uint32_t>(total_samples) & 0xFFFF, 16);
+	return output(header.data(), header.size(), user_ctx);
+}
+
+esp_err_t flac_encoder_write(FlacEncoder* encoder, const int16_t* samples, size_t sample_count, FlacOutputFn output, void* user_ctx) {
+	while (sample_count > 0) {
+		const size_t count = std::min(sample_count, FLAC_BLOCK_SIZE - encoder->block_fill);
+		std::copy(samples, samples + count, encoder->block + encoder->block_fill);
+		encoder->block_fill += count;
+		samples += count;
+		sample_count -= count;
+		if (encoder->block_fill == FLAC_BLOCK_SIZE) {
+			esp_err_t err = emit_frame(encoder, output, user_ctx);
+			if (err != ESP_OK) {
+				return err;
+			}
+		}
+	}
+	return ESP_OK;
+}
+
+esp_err_t flac_encoder_finish(FlacEncoder* encoder, FlacOutputFn output, void* user_ctx) {
+	if (encoder->block_fill == 0) {
+		return ESP_OK;
+	}
+	return emit_frame(encoder, output, user_ctx);
+}
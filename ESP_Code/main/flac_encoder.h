@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Lossless mono PCM16 encoder producing a standard FLAC stream: fixed polynomial predictors of
+// order 0 to 4 chosen per block, residuals Rice coded with a parameter per partition. Samples are
+// buffered one block at a time, so memory is bounded by FLAC_BLOCK_SIZE regardless of window length.
+static constexpr size_t FLAC_BLOCK_SIZE = 1024;
+static constexpr size_t FLAC_STREAM_HEADER_BYTES = 42;
+// A verbatim subframe plus the largest frame header and footer.
+static constexpr size_t FLAC_MAX_FRAME_BYTES = FLAC_BLOCK_SIZE * sizeof(int16_t) + 24;
+
+// Receives the encoded stream piecewise. A non-OK return stops the encoder and is passed back.
+typedef esp_err_t (*FlacOutputFn)(const uint8_t* data, size_t length, void* user_ctx);
+
+struct FlacEncoder {
+	uint32_t sample_rate;
+	uint32_t frame_number;
+	size_t block_fill;
+	int16_t block[FLAC_BLOCK_SIZE];
+	int32_t residual[FLAC_BLOCK_SIZE];
+	uint8_t frame[FLAC_MAX_FRAME_BYTES];
+};
+
+// Starts a new stream and emits the "fLaC" marker and STREAMINFO. total_samples may be 0 if unknown.
+esp_err_t flac_encoder_begin(FlacEncoder* encoder, uint32_t sample_rate, uint64_t total_samples, FlacOutputFn output, void* user_ctx);
+
+// Buffers samples and emits one frame each time a block fills.
+esp_err_t flac_encoder_write(FlacEncoder* encoder, const int16_t* samples, size_t sample_count, FlacOutputFn output, void* user_ctx);
+
+// Emits the final, possibly short, block.
+esp_err_t flac_encoder_finish(FlacEncoder* encoder, FlacOutputFn output, void* user_ctx);
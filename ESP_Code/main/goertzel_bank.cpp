@@ -0,0 +1,69 @@
+#include "goertzel_bank.h"
+
+#include <math.h>
+
+esp_err_t goertzel_bank_init(GoertzelBank* bank, size_t block_samples, const uint16_t* bins, size_t bin_count) {
+	if (bank == nullptr || block_samples < 8 || block_samples > GOERTZEL_MAX_BLOCK || bin_count > GOERTZEL_MAX_BINS || (bin_count > 0 && bins == nullptr)) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	*bank = {};
+	bank->block_samples = block_samples;
+	bank->bin_count = bin_count;
+
+	// Coefficients are worked out once here; the per-sample path is integer only.
+	const float two_pi = 6.28318531f;
+	for (size_t index = 0; index < block_samples; ++index) {
+		const float hann = 0.5f - 0.5f * cosf(two_pi * index / block_samples);
+		bank->window_q15[index] = static_cast<int16_t>(lrintf(hann * 32767.0f));
+	}
+	for (size_t bin = 0; bin < bin_count; ++bin) {
+		if (bins[bin] == 0 || bins[bin] >= block_samples / 2) {
+			return ESP_ERR_INVALID_ARG;
+		}
+		bank->coeff_q14[bin] = static_cast<int32_t>(lrintf(2.0f * cosf(two_pi * bins[bin] / block_samples) * 16384.0f));
+	}
+	return ESP_OK;
+}
+
+// Adds the finished block's bin powers and clears the filter state for the next one.
+static void finish_block(GoertzelBank* bank) {
+	const int64_t scale = static_cast<int64_t>(bank->block_samples);
+	for (size_t bin = 0; bin < bank->bin_count; ++bin) {
+		const int64_t s1 = bank->s1[bin];
+		const int64_t s2 = bank->s2[bin];
+		const int64_t power = s1 * s1 + s2 * s2 - ((bank->coeff_q14[bin] * s1) >> 14) * s2;
+		if (power > 0) {
+			bank->power[bin] += static_cast<uint64_t>(power / scale);
+		}
+		bank->s1[bin] = 0;
+		bank->s2[bin] = 0;
+	}
+	bank->block_fill = 0;
+	++bank->blocks;
+}
+
+void goertzel_bank_process(GoertzelBank* bank, const int16_t* samples, size_t sample_count) {
+	for (size_t index = 0; index < sample_count; ++index) {
+		// With at most 192 full-scale samples per block and bins of at least 1 the state stays
+		// within +-2^28, so the product fits the mul/mulh pair RV32 uses for a 64-bit result.
+		const int32_t x = (static_cast<int32_t>(samples[index]) * bank->window_q15[bank->block_fill]) >> 15;
+		for (size_t bin = 0; bin < bank->bin_count; ++bin) {
+			const int32_t s = x + static_cast<int32_t>((static_cast<int64_t>(bank->coeff_q14[bin]) * bank->s1[bin]) >> 14) - bank->s2[bin];
+			bank->s2[bin] = bank->s1[bin];
+			bank->s1[bin] = s;
+		}
+		if (++bank->block_fill == bank->block_samples) {
+			finish_block(bank);
+		}
+	}
+}
+
+uint32_t goertzel_bank_read(GoertzelBank* bank, uint64_t* powers, uint8_t shift) {
+	const uint32_t blocks = bank->blocks;
+	for (size_t bin = 0; bin < bank->bin_count; ++bin) {
+		powers[bin] = blocks > 0 ? (bank->power[bin] / blocks) >> shift : 0;
+		bank->power[bin] = 0;
+	}
+	bank->blocks = 0;
+	return blocks;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+static constexpr size_t GOERTZEL_MAX_BINS = 32;
+static constexpr size_t GOERTZEL_MAX_BLOCK = 192;
+
+// Bank of integer Goertzel filters, each evaluating one DFT bin of consecutive Hann-windowed blocks
+// of block_samples. Bin powers are averaged over the blocks completed until they are read, so the
+// caller picks its own frame length independently of the block length.
+struct GoertzelBank {
+	size_t block_samples;
+	size_t block_fill;
+	size_t bin_count;
+	uint32_t blocks;
+	int16_t window_q15[GOERTZEL_MAX_BLOCK];
+	int32_t coeff_q14[GOERTZEL_MAX_BINS];
+	int32_t s1[GOERTZEL_MAX_BINS];
+	int32_t s2[GOERTZEL_MAX_BINS];
+	// Sum over the completed blocks of |X[k]|^2 / block_samples, so white noise of mean square p
+	// reads about 0.375 p per block and a full-scale sine centred on a bin 2^26 * block_samples.
+	uint64_t power[GOERTZEL_MAX_BINS];
+};
+
+// bins are DFT bin indices of a block, each below block_samples / 2.
+esp_err_t goertzel_bank_init(GoertzelBank* bank, size_t block_samples, const uint16_t* bins, size_t bin_count);
+void goertzel_bank_process(GoertzelBank* bank, const int16_t* samples, size_t sample_count);
+// Writes each bin's mean power over the blocks completed since the last read, shifted right by
+// shift, and starts a new average. Returns the number of blocks averaged.
+uint32_t goertzel_bank_read(GoertzelBank* bank, uint64_t* powers, uint8_t shift);
@@ -0,0 +1,184 @@
+#include "log_mel_encoder.h"
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+static constexpr uint8_t OUTSIDE_BANK = 0xFF;
+// 10 * log10(2) in Q8, turning log2 into decibels.
+static constexpr int32_t DB_PER_LOG2_Q8 = 771;
+
+static float hz_to_mel(float hz) {
+	return 2595.0f * log10f(1.0f + hz / 700.0f);
+}
+
+esp_err_t log_mel_encoder_init(LogMelEncoder* encoder, uint32_t sample_rate, size_t fft_size, size_t hop_samples, size_t mel_bands, uint32_t fmin_hz, uint32_t fmax_hz) {
+	if (fmax_hz == 0) {
+		fmax_hz = sample_rate / 2;
+	}
+	if (encoder == nullptr || fft_size < 16 || fft_size > LOG_MEL_MAX_FFT || (fft_size & (fft_size - 1)) != 0 || hop_samples == 0 || hop_samples > fft_size ||
+	    mel_bands == 0 || mel_bands > LOG_MEL_MAX_BANDS || fmin_hz >= fmax_hz || fmax_hz > sample_rate / 2) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	*encoder = {};
+	encoder->format.fft_size = static_cast<uint16_t>(fft_size);
+	encoder->format.hop_samples = static_cast<uint16_t>(hop_samples);
+	encoder->format.fmin_hz = static_cast<uint16_t>(fmin_hz);
+	encoder->format.fmax_hz = static_cast<uint16_t>(fmax_hz);
+	encoder->format.mel_bands = static_cast<uint8_t>(mel_bands);
+	encoder->format.db_floor = LOG_MEL_DB_FLOOR;
+	encoder->format.db_step_q8 = LOG_MEL_DB_STEP_Q8;
+
+	// Tables are worked out once here; encoding is integer only.
+	const float two_pi = 6.28318531f;
+	for (size_t index = 0; index < fft_size; ++index) {
+		encoder->window_q15[index] = static_cast<int16_t>(lrintf((0.5f - 0.5f * cosf(two_pi * index / fft_size)) * 32767.0f));
+	}
+	for (size_t index = 0; index < fft_size / 2; ++index) {
+		encoder->cos_q15[index] = static_cast<int16_t>(lrintf(cosf(two_pi * index / fft_size) * 32767.0f));
+		encoder->sin_q15[index] = static_cast<int16_t>(lrintf(sinf(two_pi * index / fft_size) * 32767.0f));
+	}
+
+	// mel_bands + 2 points evenly spaced in mel; band b rises from point b to b + 1 and falls to b + 2.
+	const float mel_low = hz_to_mel(static_cast<float>(fmin_hz));
+	const float mel_step = (hz_to_mel(static_cast<float>(fmax_hz)) - mel_low) / (mel_bands + 1);
+	for (size_t bin = 0; bin <= fft_size / 2; ++bin) {
+		const float position = (hz_to_mel(static_cast<float>(bin) * sample_rate / fft_size) - mel_low) / mel_step;
+		if (position < 0.0f || position >= mel_bands + 1) {
+			encoder->bin_band[bin] = OUTSIDE_BANK;
+			continue;
+		}
+		const float point = floorf(position);
+		encoder->bin_band[bin] = static_cast<uint8_t>(point);
+		encoder->bin_rise_q8[bin] = static_cast<uint8_t>(std::min(255L, lrintf((position - point) * 256.0f)));
+	}
+
+	// A Hann window halves a centred sine's amplitude, which the FFT scales by fft_size / 2.
+	encoder->full_scale_log2_q8 = static_cast<int32_t>(lrintf(2.0f * log2f(32767.0f * fft_size / 4.0f) * 256.0f));
+	return ESP_OK;
+}
+
+esp_err_t log_mel_encoder_begin(LogMelEncoder* encoder, LogMelOutputFn output, void* user_ctx) {
+	log_mel_encoder_reset(encoder);
+	return output(reinterpret_cast<const uint8_t*>(&encoder->format), sizeof(encoder->format), user_ctx);
+}
+
+void log_mel_encoder_reset(LogMelEncoder* encoder) {
+	encoder->fill = 0;
+}
+
+static size_t reverse_bits(size_t value, size_t bits) {
+	size_t reversed = 0;
+	for (size_t bit = 0; bit < bits; ++bit) {
+		reversed = (reversed << 1) | ((value >> bit) & 1);
+	}
+	return reversed;
+}
+
+// In-place radix-2 decimation-in-time FFT of re/im, which are already in bit-reversed order.
+// Windowed PCM16 grows by at most fft_size over the transform, so values stay within 2^24 and
+// each twiddle product fits the 64-bit mul/mulh pair.
+static void fft(LogMelEncoder* encoder) {
+	const size_t fft_size = encoder->format.fft_size;
+	int32_t* re = encoder->re;
+	int32_t* im = encoder->im;
+	for (size_t half = 1, stride = fft_size / 2; half < fft_size; half *= 2, stride /= 2) {
+		for (size_t start = 0; start < fft_size; start += 2 * half) {
+			for (size_t offset = 0; offset < half; ++offset) {
+				const int64_t c = encoder->cos_q15[offset * stride];
+				const int64_t s = encoder->sin_q15[offset * stride];
+				const size_t top = start + offset;
+				const size_t bottom = top + half;
+				// Multiplies by e^(-j 2 pi offset / (2 half)).
+				const int32_t tr = static_cast<int32_t>((c * re[bottom] + s * im[bottom]) >> 15);
+				const int32_t ti = static_cast<int32_t>((c * im[bottom] - s * re[bottom]) >> 15);
+				re[bottom] = re[top] - tr;
+				im[bottom] = im[top] - ti;
+				re[top] += tr;
+				im[top] += ti;
+			}
+		}
+	}
+}
+
+// log2(value) in Q8, using a quadratic fit for the fraction (error below 0.01).
+static int32_t log2_q8(uint64_t value) {
+	const int32_t msb = 63 - __builtin_clzll(value);
+	const uint32_t fraction = static_cast<uint32_t>(msb >= 8 ? value >> (msb - 8) : value << (8 - msb)) & 0xFF;
+	return msb * 256 + static_cast<int32_t>(fraction + ((fraction * (256 - fraction) * 89) >> 16));
+}
+
+static uint8_t quantize_band(const LogMelEncoder* encoder, uint64_t power_q8) {
+	if (power_q8 == 0) {
+		return 0;
+	}
+	const int32_t relative_log2_q8 = log2_q8(power_q8) - 8 * 256 - encoder->full_scale_log2_q8;
+	const int32_t db_q8 = relative_log2_q8 * DB_PER_LOG2_Q8 / 256;
+	const int32_t step = encoder->format.db_step_q8;
+	const int32_t value = (db_q8 - encoder->format.db_floor * 256 + step / 2) / step;
+	return static_cast<uint8_t>(std::clamp<int32_t>(value, 0, 255));
+}
+
+static void encode_frame(LogMelEncoder* encoder) {
+	const size_t fft_size = encoder->format.fft_size;
+	const size_t bits = static_cast<size_t>(__builtin_ctz(static_cast<unsigned>(fft_size)));
+	for (size_t index = 0; index < fft_size; ++index) {
+		const size_t target = reverse_bits(index, bits);
+		encoder->re[target] = (static_cast<int32_t>(encoder->samples[index]) * encoder->window_q15[index]) >> 15;
+		encoder->im[target] = 0;
+	}
+	fft(encoder);
+
+	const size_t mel_bands = encoder->format.mel_bands;
+	uint64_t bands[LOG_MEL_MAX_BANDS] = {};
+	for (size_t bin = 0; bin <= fft_size / 2; ++bin) {
+		const uint8_t band = encoder->bin_band[bin];
+		if (band == OUTSIDE_BANK) {
+			continue;
+		}
+		const int64_t re = encoder->re[bin];
+		const int64_t im = encoder->im[bin];
+		const uint64_t power = static_cast<uint64_t>(re * re + im * im);
+		const uint32_t rise = encoder->bin_rise_q8[bin];
+		if (band < mel_bands) {
+			bands[band] += power * rise;
+		}
+		if (band > 0) {
+			bands[band - 1] += power * (256 - rise);
+		}
+	}
+	for (size_t band = 0; band < mel_bands; ++band) {
+		encoder->frame[band] = quantize_band(encoder, bands[band]);
+	}
+}
+
+esp_err_t log_mel_encoder_write(LogMelEncoder* encoder, const int16_t* samples, size_t sample_count, LogMelOutputFn output, void* user_ctx) {
+	const size_t fft_size = encoder->format.fft_size;
+	const size_t hop_samples = encoder->format.hop_samples;
+	while (sample_count > 0) {
+		const size_t take = std::min(sample_count, fft_size - encoder->fill);
+		memcpy(encoder->samples + encoder->fill, samples, take * sizeof(int16_t));
+		encoder->fill += take;
+		samples += take;
+		sample_count -= take;
+		if (encoder->fill < fft_size) {
+			break;
+		}
+
+		encode_frame(encoder);
+		esp_err_t err = output(encoder->frame, encoder->format.mel_bands, user_ctx);
+		if (err != ESP_OK) {
+			return err;
+		}
+		memmove(encoder->samples, encoder->samples + hop_samples, (fft_size - hop_samples) * sizeof(int16_t));
+		encoder->fill = fft_size - hop_samples;
+	}
+	return ESP_OK;
+}
+
+size_t log_mel_encoded_size(const LogMelEncoder* encoder, size_t sample_count) {
+	const size_t fft_size = encoder->format.fft_size;
+	const size_t frames = sample_count >= fft_size ? (sample_count - fft_size) / encoder->format.hop_samples + 1 : 0;
+	return sizeof(ClipLogMel) + frames * encoder->format.mel_bands;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "clip_header.h"
+#include "esp_err.h"
+
+static constexpr size_t LOG_MEL_MAX_FFT = 512;
+static constexpr size_t LOG_MEL_MAX_BANDS = 64;
+// Feature value 0 is -120 dBFS and each step 0.5 dB, so 240 is a full-scale sine.
+static constexpr int16_t LOG_MEL_DB_FLOOR = -120;
+static constexpr uint16_t LOG_MEL_DB_STEP_Q8 = 128;
+
+// Receives the encoded features piecewise. A non-OK return stops the encoder and is passed back.
+typedef esp_err_t (*LogMelOutputFn)(const uint8_t* data, size_t length, void* user_ctx);
+
+// Turns PCM16 into 8-bit log-mel spectrogram frames: a Hann-windowed fft_size-point fixed-point FFT
+// every hop_samples samples, triangular mel filters between fmin and fmax, and the log power of
+// each band quantized as described by ClipLogMel. Samples are buffered one FFT at a time, so a
+// window of any length is encoded in bounded memory; a tail shorter than the next hop is dropped.
+struct LogMelEncoder {
+	ClipLogMel format;
+	size_t fill;
+	int16_t samples[LOG_MEL_MAX_FFT];
+	int16_t window_q15[LOG_MEL_MAX_FFT];
+	int16_t cos_q15[LOG_MEL_MAX_FFT / 2];
+	int16_t sin_q15[LOG_MEL_MAX_FFT / 2];
+	int32_t re[LOG_MEL_MAX_FFT];
+	int32_t im[LOG_MEL_MAX_FFT];
+	// FFT bin k lies on the rising slope of band bin_band[k] with weight bin_rise_q8[k] and on the
+	// falling slope of the band below with the remaining weight. 0xFF marks bins outside the bank.
+	uint8_t bin_band[LOG_MEL_MAX_FFT / 2 + 1];
+	uint8_t bin_rise_q8[LOG_MEL_MAX_FFT / 2 + 1];
+	// log2 of the power of a full-scale sine centred on a bin, Q8.
+	int32_t full_scale_log2_q8;
+	uint8_t frame[LOG_MEL_MAX_BANDS];
+};
+
+// fft_size must be a power of two up to LOG_MEL_MAX_FFT and hop_samples at most fft_size.
+// fmax_hz of 0 means the Nyquist frequency.
+esp_err_t log_mel_encoder_init(LogMelEncoder* encoder, uint32_t sample_rate, size_t fft_size, size_t hop_samples, size_t mel_bands, uint32_t fmin_hz, uint32_t fmax_hz);
+
+// Starts a new clip body and emits its ClipLogMel.
+esp_err_t log_mel_encoder_begin(LogMelEncoder* encoder, LogMelOutputFn output, void* user_ctx);
+// Starts a new stream of frames without a ClipLogMel, for callers that consume the frames themselves.
+void log_mel_encoder_reset(LogMelEncoder* encoder);
+
+// Buffers samples and emits one frame of mel_bands bytes each time a hop completes a full FFT.
+esp_err_t log_mel_encoder_write(LogMelEncoder* encoder, const int16_t* samples, size_t sample_count, LogMelOutputFn output, void* user_ctx);
+
+// Bytes a clip of sample_count samples encodes to, including its ClipLogMel.
+size_t log_mel_encoded_size(const LogMelEncoder* encoder, size_t sample_count);
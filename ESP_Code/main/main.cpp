@@ -5,6 +5,7 @@
 
 #include "microphone_uploader.h"
 #include "network_rest.h"
+#include "sdkconfig.h"
 
 #define TAG "simple_connect_example"
 
@@ -16,31 +17,31 @@
 #define I2S_DOUT_GPIO GPIO_NUM_4
 
 static MicUploaderConfig mic_uploader_config = {
+#if CONFIG_MIC_UPLOAD_CODEC_LOG_MEL
+	.endpoint = "http://66.42.127.17:5000/features",
+#else
 	.endpoint = "http://66.42.127.17:5000/upload",
+#endif
 	.i2s_sel_gpio = I2S_SEL_GPIO,
 	.i2s_lrcl_gpio = I2S_LRCL_GPIO,
 	.i2s_dout_gpio = I2S_DOUT_GPIO,
 	.i2s_bclk_gpio = I2S_BCLK_GPIO,
 	.blink_gpio = BLINK_GPIO,
-	.task_stack_size = 8192,
-	.task_priority = 5,
+	.capture_task_stack_size = 8192,
+	.capture_task_priority = 6,
+	.upload_task_stack_size = 8192,
+	.upload_task_priority = 4,
+	.drain_task_stack_size = 6144,
+	.drain_task_priority = 3,
 };
 
 extern "C" void app_main() {
 	ESP_ERROR_CHECK(app_network_init_and_connect());
 	app_log_connected_ap_info();
 
-	BaseType_t task_ok = xTaskCreate(
-		microphone_uploader_task,
-		"microphone_uploader_task",
-		static_cast<uint32_t>(mic_uploader_config.task_stack_size),
-		&mic_uploader_config,
-		static_cast<UBaseType_t>(mic_uploader_config.task_priority),
-		nullptr
-	);
-
-	if (task_ok != pdPASS) {
-		ESP_LOGE(TAG, "Failed to create microphone uploader task");
+	esp_err_t err = microphone_uploader_start(&mic_uploader_config);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "Failed to start microphone uploader: %s", esp_err_to_name(err));
 		return;
 	}
 
@@ -3,33 +3,232 @@
 #include <numeric>
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <deque>
 #include <limits>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "driver/i2s.h"
+#include "freertos/queue.h"
+#include "driver/i2s_std.h"
 #include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_mac.h"
+#include "esp_random.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "adpcm_encoder.h"
+#include "audio_ring.h"
+#include "capture_pool.h"
+#include "capture_settings.h"
+#include "bird_classifier.h"
+#include "clip_header.h"
+#include "activity_detector.h"
+#include "clip_queue.h"
+#include "dc_blocker.h"
+#include "decimator.h"
+#include "flac_encoder.h"
+#include "log_mel_encoder.h"
 #include "network_rest.h"
-#include "driver/adc.h"
+#include "power_manager.h"
+#include "sound_trigger.h"
+#include "upload_retry.h"
 #include "sdkconfig.h"
 
 static constexpr i2s_port_t I2S_PORT = I2S_NUM_0;
-static constexpr size_t READ_CHUNK_SIZE = 2048;
 static constexpr int MIC_SAMPLE_RATE_HZ = CONFIG_MIC_SAMPLE_RATE_HZ;
+static constexpr size_t DECIMATION_FACTOR = CONFIG_MIC_DECIMATION_FACTOR;
+static constexpr int UPLOAD_SAMPLE_RATE_HZ = MIC_SAMPLE_RATE_HZ / static_cast<int>(DECIMATION_FACTOR);
+static_assert(MIC_SAMPLE_RATE_HZ % DECIMATION_FACTOR == 0, "MIC_SAMPLE_RATE_HZ must be a multiple of the decimation ratio, or uploads report a truncated rate");
 static constexpr int I2S_SELECT_LEVEL = 0;
 static constexpr size_t PCM_BYTES_PER_SAMPLE = sizeof(int16_t);
 static constexpr size_t I2S_READ_BYTES_PER_SAMPLE = sizeof(int32_t);
-static constexpr size_t I2S_READ_CHUNK_BYTES = READ_CHUNK_SIZE * 2;
+static constexpr int MIC_SAMPLE_BITS = 24;
+static constexpr int MIC_EXTRA_BITS = MIC_SAMPLE_BITS - 16;
+#if CONFIG_MIC_VAD_ENABLE
+static constexpr size_t VAD_FRAME_MS = 20;
+#endif
+#if CONFIG_MIC_AGC_ENABLE
+static constexpr uint8_t AGC_MAX_GAIN_LOG2 = CONFIG_MIC_AGC_MAX_GAIN_DB / 6;
+static constexpr int32_t AGC_TARGET_PEAK = std::numeric_limits<int16_t>::max() / 2;
+#endif
+static constexpr uint32_t I2S_DMA_DESC_NUM = 8;
+static constexpr uint32_t I2S_DMA_FRAME_NUM = 512;
+// The driver recycles a DMA buffer after the other descriptors have filled, so frames queued for
+// the capture task are capped below the descriptor count to keep each one intact until it is read.
+static constexpr size_t DMA_FRAME_QUEUE_DEPTH = I2S_DMA_DESC_NUM - 2;
 
-#define MILLISECONDS_TO_BYTES_PCM16(milliseconds) ((static_cast<size_t>(MIC_SAMPLE_RATE_HZ) * PCM_BYTES_PER_SAMPLE * static_cast<size_t>(milliseconds) / 1000))
+#define MILLISECONDS_TO_BYTES_PCM16(milliseconds) ((static_cast<size_t>(UPLOAD_SAMPLE_RATE_HZ) * PCM_BYTES_PER_SAMPLE * static_cast<size_t>(milliseconds) / 1000))
 
-static constexpr size_t BYTES_PER_UPLOAD = MILLISECONDS_TO_BYTES_PCM16(CONFIG_MIC_UPLOAD_WINDOW_MS);
+// Window lengths are set at runtime (capture_settings), within the Kconfig range.
+static constexpr uint32_t MAX_WINDOW_MS = 60000;
+#if CONFIG_MIC_TRIM_ENABLE
+static constexpr size_t TRIM_PADDING_SAMPLES = static_cast<size_t>(UPLOAD_SAMPLE_RATE_HZ) * CONFIG_MIC_TRIM_PADDING_MS / 1000;
+static constexpr size_t TRIM_SEGMENT_SAMPLES = static_cast<size_t>(UPLOAD_SAMPLE_RATE_HZ) * CONFIG_MIC_TRIM_SEGMENT_MS / 1000;
+#endif
+#if CONFIG_MIC_TRIGGER_ENABLE
+// Audio kept from before the trigger fired and prepended to the first window of a capture.
+static constexpr size_t PREROLL_SAMPLES = MILLISECONDS_TO_BYTES_PCM16(CONFIG_MIC_PREROLL_MS) / PCM_BYTES_PER_SAMPLE;
+#else
+static constexpr size_t PREROLL_SAMPLES = 0;
+#endif
+#if CONFIG_MIC_UPLOAD_STREAMING
+// Streaming drains the ring chunk by chunk, so it only has to absorb network jitter and the
+// window length is independent of the ring size.
+static constexpr size_t RING_CAPACITY_SAMPLES = MILLISECONDS_TO_BYTES_PCM16(CONFIG_MIC_STREAM_RING_MS) / PCM_BYTES_PER_SAMPLE + PREROLL_SAMPLES;
+#else
+// The ring holds several whole windows so capture can fill the next one while the previous one
+// uploads straight out of ring memory. It is sized for the longest window the capture pool allows,
+// so a shorter window simply leaves more slots.
+static constexpr size_t WINDOW_SLOTS = CONFIG_MIC_CAPTURE_WINDOW_SLOTS;
+static constexpr size_t CAPTURE_POOL_BYTES = CONFIG_MIC_CAPTURE_POOL_KB * 1024;
+#endif
+static constexpr size_t WINDOW_QUEUE_DEPTH = 8;
+// A hop of at least a quarter window keeps this many windows open at once.
+static constexpr size_t MAX_OPEN_WINDOWS = 4;
+static constexpr const char* SPOOL_PARTITION_LABEL = "clips";
+static constexpr const char* MODEL_PARTITION_LABEL = "model";
+#if CONFIG_MIC_UPLOAD_CODEC_IMA_ADPCM
+static constexpr const char* UPLOAD_ENCODING = "ima-adpcm";
+static constexpr ClipCodec UPLOAD_CODEC = ClipCodec::ImaAdpcm;
+#elif CONFIG_MIC_UPLOAD_CODEC_FLAC
+static constexpr const char* UPLOAD_ENCODING = "flac";
+static constexpr ClipCodec UPLOAD_CODEC = ClipCodec::Flac;
+#elif CONFIG_MIC_UPLOAD_CODEC_LOG_MEL
+static constexpr const char* UPLOAD_ENCODING = "log-mel";
+static constexpr ClipCodec UPLOAD_CODEC = ClipCodec::LogMel;
+static_assert(CONFIG_MIC_MEL_HOP_SAMPLES <= CONFIG_MIC_MEL_FFT_SIZE, "MIC_MEL_HOP_SAMPLES must not exceed the log-mel FFT size");
+#else
+static constexpr const char* UPLOAD_ENCODING = "pcm16";
+static constexpr ClipCodec UPLOAD_CODEC = ClipCodec::Pcm16;
+#endif
+// Anything earlier means the clock has not been set by SNTP yet.
+static constexpr time_t MIN_VALID_EPOCH_SECONDS = 1704067200;  // 2024-01-01
 static const char* TAG = "mic_uploader";
 
-// Sound level sensor is used to determine when to start recording with the microphone, which uses I2S.
-#define SOUND_LEVEL_SENSOR_GPIO GPIO_NUM_2
+enum class WindowEvent : uint8_t {
+	Begin,
+	End,
+};
+
+// Window boundary handed from the capture task to the upload task. The samples stay in the ring;
+// only their absolute position travels through the queue. End events carry the window stats.
+struct CapturedWindow {
+	WindowEvent event;
+	uint32_t sequence;
+	uint64_t first_sample;
+	int64_t start_time_us;
+	size_t sample_count;
+	size_t preroll_samples;
+	int16_t min_sample;
+	int16_t max_sample;
+	size_t non_zero_samples;
+	int16_t dc_offset;  // at unity gain
+	uint8_t gain_log2;
+	size_t target_samples;  // sample_count at which the window closes, fixed when it opens
+	size_t hop_samples;     // distance to the start of the next window
+	uint64_t release_sample;  // ring position the window may free up to once handled, set at End
+	size_t active_frames;
+	// Ring positions bounding the active frames, tracked during capture; both 0 while none.
+	uint64_t active_begin;
+	uint64_t active_end;
+	// Set once the window is trimmed: where the span starts in the window and the window's length.
+	size_t trim_offset;
+	size_t window_samples;
+	uint32_t samples_dropped;
+	std::array<int16_t, 8> first_samples;
+};
+
+// Completed DMA buffer handed from the I2S receive ISR to the capture task without copying.
+struct DmaFrame {
+	const int32_t* samples;
+	size_t sample_count;
+};
+
+static i2s_chan_handle_t s_rx_channel = nullptr;
+static QueueHandle_t s_dma_frame_queue = nullptr;
+static volatile uint32_t s_dma_overruns = 0;
+static Decimator s_decimator;
+#if CONFIG_MIC_DC_BLOCK_ENABLE
+static DcBlocker s_dc_blocker;
+// About 5 Hz at the capture rate: far below any bird call, above the mic's drift.
+static constexpr uint8_t DC_BLOCK_SHIFT = dc_blocker_shift_for_cutoff(MIC_SAMPLE_RATE_HZ, 5);
+#endif
+// Samples are kept as PCM16 shifted left by s_gain_log2 (6 dB steps) relative to the top 16 bits
+// of the mic's word, up to the MIC_EXTRA_BITS that a 24-bit mic has below them.
+static uint8_t s_gain_log2 = 0;
+static int32_t s_gain_peak = 0;
+static CapturePool s_pool;
+static AudioRing s_ring;
+static size_t s_ring_capacity = 0;
+// Upload-encoded window, for codecs that encode a whole window before sending it.
+static uint8_t* s_encoded = nullptr;
+static size_t s_encoded_capacity = 0;
+static CaptureSettings s_settings;
+static uint32_t s_ignored_window_ms = 0;
+static portMUX_TYPE s_settings_lock = portMUX_INITIALIZER_UNLOCKED;
+static std::atomic<size_t> s_window_samples{0};
+static std::atomic<size_t> s_hop_samples{0};
+// Random per boot; clip headers count first_sample from 0 within it.
+static uint32_t s_stream_id = 0;
+static size_t s_max_window_samples = 0;
+static uint64_t s_last_window_end = 0;
+static QueueHandle_t s_window_queue = nullptr;
+static TaskHandle_t s_upload_task = nullptr;
+static HttpUploader s_http_uploader;
+static uint8_t s_device_mac[6];
+#if CONFIG_MIC_UPLOAD_CODEC_IMA_ADPCM
+static AdpcmEncoder s_adpcm_encoder;
+#elif CONFIG_MIC_UPLOAD_CODEC_FLAC
+static FlacEncoder s_flac_encoder;
+#elif CONFIG_MIC_UPLOAD_CODEC_LOG_MEL
+static LogMelEncoder s_log_mel_encoder;
+#endif
+static std::atomic<uint32_t> s_windows_captured{0};
+static std::atomic<uint32_t> s_windows_uploaded{0};
+static std::atomic<uint32_t> s_windows_suppressed{0};
+static WindowHourStats s_hourly[MIC_STATS_HOURS];
+static uint32_t s_current_hour = 0;
+static portMUX_TYPE s_hourly_lock = portMUX_INITIALIZER_UNLOCKED;
+#if CONFIG_MIC_VAD_ENABLE
+static ActivityDetector s_activity;
+// Ring position just past the newest samples that completed an active frame.
+static std::atomic<uint64_t> s_last_active_sample{0};
+static uint32_t s_heartbeat_windows = 0;
+static uint32_t s_heartbeat_samples = 0;
+static int64_t s_last_heartbeat_us = 0;
+#endif
+static std::atomic<uint32_t> s_samples_dropped{0};
+// Flash queue of windows that could not be uploaded, replayed by the drain task on its own connection.
+static ClipQueue s_clip_queue;
+static bool s_spool_ready = false;
+static TaskHandle_t s_drain_task = nullptr;
+#if CONFIG_MIC_SPOOL_ENABLE
+static HttpUploader s_drain_uploader;
+#endif
+static RetryBackoff s_backoff;
+static constexpr RetryPolicy RETRY_POLICY = {
+	.base_delay_ms = CONFIG_MIC_RETRY_BASE_MS,
+	.max_delay_ms = CONFIG_MIC_RETRY_MAX_MS,
+	.max_attempts = CONFIG_MIC_RETRY_MAX_ATTEMPTS,
+};
+
+// Runs in ISR context for every filled DMA buffer. The buffer address goes straight to the capture
+// task; if the task has fallen so far behind that the queue is full, the frame is lost and counted.
+static bool IRAM_ATTR on_i2s_recv(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user_ctx) {
+	DmaFrame frame = {};
+	frame.samples = static_cast<const int32_t*>(event->dma_buf);
+	frame.sample_count = event->size / I2S_READ_BYTES_PER_SAMPLE;
 
+	BaseType_t need_yield = pdFALSE;
+	if (xQueueSendFromISR(s_dma_frame_queue, &frame, &need_yield) != pdTRUE) {
+		s_dma_overruns = s_dma_overruns + 1;
+	}
+	return need_yield == pdTRUE;
+}
 
 static esp_err_t init_i2s_mic(const MicUploaderConfig* config) {
 	if (config == nullptr) {
@@ -40,117 +239,313 @@ static esp_err_t init_i2s_mic(const MicUploaderConfig* config) {
 	gpio_set_direction(config->i2s_sel_gpio, GPIO_MODE_OUTPUT);
 	gpio_set_level(config->i2s_sel_gpio, I2S_SELECT_LEVEL);
 
-    gpio_reset_pin(SOUND_LEVEL_SENSOR_GPIO);
-    gpio_set_direction(SOUND_LEVEL_SENSOR_GPIO, GPIO_MODE_INPUT);
-    gpio_set_pull_mode(SOUND_LEVEL_SENSOR_GPIO, GPIO_FLOATING);
-    adc1_config_width(ADC_WIDTH_BIT_12);
-    adc1_config_channel_atten(ADC1_CHANNEL_2, ADC_ATTEN_DB_11);
-
-	i2s_config_t i2s_config = {};
-	i2s_config.mode = static_cast<i2s_mode_t>(I2S_MODE_MASTER | I2S_MODE_RX);
-	i2s_config.sample_rate = MIC_SAMPLE_RATE_HZ;
-	i2s_config.bits_per_sample = I2S_BITS_PER_SAMPLE_32BIT;
-	i2s_config.channel_format = I2S_CHANNEL_FMT_ONLY_LEFT;
-#ifdef I2S_COMM_FORMAT_STAND_I2S
-	i2s_config.communication_format = I2S_COMM_FORMAT_STAND_I2S;
-#else
-	i2s_config.communication_format = I2S_COMM_FORMAT_I2S;
-#endif
-	i2s_config.intr_alloc_flags = ESP_INTR_FLAG_LEVEL1;
-	i2s_config.dma_buf_count = 8;
-	i2s_config.dma_buf_len = 512;
-	i2s_config.use_apll = false;
-	i2s_config.tx_desc_auto_clear = false;
-	i2s_config.fixed_mclk = 0;
-
-	i2s_pin_config_t pin_config = {};
-	pin_config.bck_io_num = config->i2s_bclk_gpio;
-	pin_config.ws_io_num = config->i2s_lrcl_gpio;
-	pin_config.data_out_num = I2S_PIN_NO_CHANGE;
-	pin_config.data_in_num = config->i2s_dout_gpio;
-
-	esp_err_t err = i2s_driver_install(I2S_PORT, &i2s_config, 0, nullptr);
+	i2s_chan_config_t chan_config = I2S_CHANNEL_DEFAULT_CONFIG(I2S_PORT, I2S_ROLE_MASTER);
+	chan_config.dma_desc_num = I2S_DMA_DESC_NUM;
+	chan_config.dma_frame_num = I2S_DMA_FRAME_NUM;
+
+	esp_err_t err = i2s_new_channel(&chan_config, nullptr, &s_rx_channel);
 	if (err != ESP_OK) {
-		ESP_LOGE(TAG, "i2s_driver_install failed: %s", esp_err_to_name(err));
+		ESP_LOGE(TAG, "i2s_new_channel failed: %s", esp_err_to_name(err));
 		return err;
 	}
 
-	err = i2s_set_pin(I2S_PORT, &pin_config);
+	i2s_std_config_t std_config = {};
+	std_config.clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(MIC_SAMPLE_RATE_HZ);
+	std_config.slot_cfg = I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_32BIT, I2S_SLOT_MODE_MONO);
+	std_config.slot_cfg.slot_mask = I2S_STD_SLOT_LEFT;
+	std_config.gpio_cfg.mclk = I2S_GPIO_UNUSED;
+	std_config.gpio_cfg.bclk = config->i2s_bclk_gpio;
+	std_config.gpio_cfg.ws = config->i2s_lrcl_gpio;
+	std_config.gpio_cfg.dout = I2S_GPIO_UNUSED;
+	std_config.gpio_cfg.din = config->i2s_dout_gpio;
+
+	err = i2s_channel_init_std_mode(s_rx_channel, &std_config);
 	if (err != ESP_OK) {
-		ESP_LOGE(TAG, "i2s_set_pin failed: %s", esp_err_to_name(err));
+		ESP_LOGE(TAG, "i2s_channel_init_std_mode failed: %s", esp_err_to_name(err));
 		return err;
 	}
 
-	err = i2s_zero_dma_buffer(I2S_PORT);
+	s_dma_frame_queue = xQueueCreate(DMA_FRAME_QUEUE_DEPTH, sizeof(DmaFrame));
+	if (s_dma_frame_queue == nullptr) {
+		ESP_LOGE(TAG, "Failed to create DMA frame queue");
+		return ESP_ERR_NO_MEM;
+	}
+
+	// on_recv_q_ovf is left unset: it reports the driver's i2s_channel_read queue, which this path
+	// never drains, so it would fire on every frame. Overruns are counted in on_i2s_recv instead.
+	i2s_event_callbacks_t callbacks = {};
+	callbacks.on_recv = on_i2s_recv;
+	err = i2s_channel_register_event_callback(s_rx_channel, &callbacks, nullptr);
 	if (err != ESP_OK) {
-		ESP_LOGE(TAG, "i2s_zero_dma_buffer failed: %s", esp_err_to_name(err));
+		ESP_LOGE(TAG, "i2s_channel_register_event_callback failed: %s", esp_err_to_name(err));
 		return err;
 	}
 
 	return ESP_OK;
 }
 
-static int16_t convert_i2s_32_to_pcm16(int32_t raw_sample) {
-	const int32_t shifted = raw_sample >> 16;
-	if (shifted > std::numeric_limits<int16_t>::max()) {
+static esp_err_t start_i2s_capture() {
+	esp_err_t err = i2s_channel_enable(s_rx_channel);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "i2s_channel_enable failed: %s", esp_err_to_name(err));
+	}
+	return err;
+}
+
+#if CONFIG_MIC_TRIGGER_ENABLE
+// Frames still queued from before the channel stopped would point at recycled DMA buffers.
+static void stop_i2s_capture() {
+	ESP_ERROR_CHECK_WITHOUT_ABORT(i2s_channel_disable(s_rx_channel));
+	xQueueReset(s_dma_frame_queue);
+	if (DECIMATION_FACTOR > 1) {
+		decimator_reset(&s_decimator);
+	}
+}
+#endif
+
+static int16_t saturate_pcm16(int32_t sample) {
+	if (sample > std::numeric_limits<int16_t>::max()) {
 		return std::numeric_limits<int16_t>::max();
 	}
-	if (shifted < std::numeric_limits<int16_t>::min()) {
+	if (sample < std::numeric_limits<int16_t>::min()) {
 		return std::numeric_limits<int16_t>::min();
 	}
-	return static_cast<int16_t>(shifted);
+	return static_cast<int16_t>(sample);
+}
+
+// Takes the mic's 24-bit samples from the I2S words, removes the DC offset at full resolution and
+// keeps the 16 bits selected by the current gain. Also tracks the peak that picks the next gain.
+static void convert_i2s_samples(const int32_t* raw_samples, size_t sample_count, int16_t* output) {
+	const int shift = MIC_EXTRA_BITS - s_gain_log2;
+	int32_t peak = s_gain_peak;
+	for (size_t sample_index = 0; sample_index < sample_count; ++sample_index) {
+		int32_t sample = raw_samples[sample_index] >> (32 - MIC_SAMPLE_BITS);
+#if CONFIG_MIC_DC_BLOCK_ENABLE
+		sample = dc_blocker_process(&s_dc_blocker, sample);
+#endif
+		peak = std::max(peak, sample < 0 ? -sample : sample);
+		output[sample_index] = saturate_pcm16(sample >> shift);
+	}
+	s_gain_peak = peak;
 }
 
-// static int16_t clamp_to_pcm16(int32_t value) {
-// 	if (value > std::numeric_limits<int16_t>::max()) {
-// 		return std::numeric_limits<int16_t>::max();
-// 	}
-// 	if (value < std::numeric_limits<int16_t>::min()) {
-// 		return std::numeric_limits<int16_t>::min();
-// 	}
-// 	return static_cast<int16_t>(value);
-// }
+#if CONFIG_MIC_AGC_ENABLE
+// Picks the next window's gain from the peak seen since the last update: straight down to the
+// largest gain that keeps that peak 6 dB under full scale, but up by at most one step per window,
+// so a single quiet window cannot set up the next loud one to clip.
+static uint8_t next_gain() {
+	uint8_t fitting_gain = 0;
+	while (fitting_gain < AGC_MAX_GAIN_LOG2 && (s_gain_peak >> (MIC_EXTRA_BITS - fitting_gain - 1)) <= AGC_TARGET_PEAK) {
+		++fitting_gain;
+	}
+	return std::min<uint8_t>(fitting_gain, s_gain_log2 + 1);
+}
 
-// static int16_t remove_dc_offset(int16_t* samples, size_t sample_count) {
-// 	if (samples == nullptr || sample_count == 0) {
-// 		return 0;
-// 	}
+static void update_gain() {
+	s_gain_log2 = next_gain();
+	s_gain_peak = 0;
+}
+#endif
+
+// Wall-clock time in microseconds since the Unix epoch, or 0 while the clock is unset.
+static int64_t wall_clock_us() {
+	timeval now = {};
+	gettimeofday(&now, nullptr);
+	if (now.tv_sec < MIN_VALID_EPOCH_SECONDS) {
+		return 0;
+	}
+	return static_cast<int64_t>(now.tv_sec) * 1000000 + now.tv_usec;
+}
 
-// 	int64_t sum = 0;
-// 	for (size_t index = 0; index < sample_count; ++index) {
-// 		sum += samples[index];
-// 	}
+static int64_t samples_to_us(uint64_t samples) {
+	return static_cast<int64_t>(samples * 1000000 / UPLOAD_SAMPLE_RATE_HZ);
+}
 
-// 	const int32_t mean = static_cast<int32_t>(sum / static_cast<int64_t>(sample_count));
-// 	for (size_t index = 0; index < sample_count; ++index) {
-// 		samples[index] = clamp_to_pcm16(static_cast<int32_t>(samples[index]) - mean);
-// 	}
+// Opens a window at the ring head, reaching back over up to preroll_samples already in the ring.
+// The pre-roll is never copied; the window simply starts earlier in the ring.
+static void begin_window(CapturedWindow* window, uint32_t sequence, size_t preroll_samples) {
+	const uint64_t head = audio_ring_head(&s_ring);
+	uint64_t first_sample = head - std::min<uint64_t>(head, preroll_samples);
+	first_sample = std::max({first_sample, audio_ring_tail(&s_ring), s_last_window_end});
 
-// 	return static_cast<int16_t>(mean);
-// }
+	*window = {};
+	window->event = WindowEvent::Begin;
+	window->sequence = sequence;
+	window->first_sample = first_sample;
+	window->preroll_samples = static_cast<size_t>(head - first_sample);
+	window->sample_count = window->preroll_samples;
+	const int64_t now_us = wall_clock_us();
+	window->start_time_us = now_us > 0 ? now_us - samples_to_us(window->preroll_samples) : 0;
+	window->min_sample = std::numeric_limits<int16_t>::max();
+	window->max_sample = std::numeric_limits<int16_t>::min();
+	// The gain only changes between windows, so it also applies to any pre-roll already stored.
+	window->gain_log2 = s_gain_log2;
+	// Read together, so a window never pairs a new length with the old hop.
+	portENTER_CRITICAL(&s_settings_lock);
+	window->target_samples = window->preroll_samples + s_window_samples;
+	window->hop_samples = s_hop_samples;
+	portEXIT_CRITICAL(&s_settings_lock);
 
-void microphone_uploader_task(void* pv_parameters) {
-	const MicUploaderConfig* config = static_cast<const MicUploaderConfig*>(pv_parameters);
-	if (config == nullptr || config->endpoint == nullptr) {
-		ESP_LOGE(TAG, "Invalid microphone uploader configuration");
-		vTaskDelete(nullptr);
-		return;
+	if (xQueueSend(s_window_queue, window, 0) != pdTRUE) {
+		ESP_LOGE(TAG, "Window queue full, window %u start not delivered", static_cast<unsigned>(window->sequence));
 	}
+}
 
-	esp_err_t init_err = init_i2s_mic(config);
-	if (init_err != ESP_OK) {
-		ESP_LOGE(TAG, "I2S initialization failed");
-		vTaskDelete(nullptr);
+// Closes a window whose upload frees the ring up to release_sample, which is short of its end
+// while a later window is still open over its tail. The gain is then left to close_due_windows(),
+// since a step would land inside that window.
+static void end_window(CapturedWindow* window, uint64_t release_sample) {
+	++s_windows_captured;
+	s_last_window_end = window->first_sample + window->sample_count;
+#if CONFIG_MIC_AGC_ENABLE
+	if (release_sample == s_last_window_end) {
+		update_gain();
+	}
+#endif
+	window->release_sample = release_sample;
+	window->event = WindowEvent::End;
+	if (xQueueSend(s_window_queue, window, 0) != pdTRUE) {
+		ESP_LOGE(TAG, "Window queue full, dropping window %u", static_cast<unsigned>(window->sequence));
+		audio_ring_release(&s_ring, window->release_sample);
+		s_samples_dropped += static_cast<uint32_t>(window->sample_count);
+	}
+}
+
+// Windows of the capture in progress, oldest first. Overlapping windows are views of the same ring
+// samples; each only keeps its own stats.
+struct OpenWindows {
+	std::array<CapturedWindow, MAX_OPEN_WINDOWS> windows;
+	size_t count;
+	uint32_t next_sequence;
+	uint64_t next_start;  // ring position at which the next window opens
+};
+
+static void open_window(OpenWindows* open, size_t preroll_samples) {
+	if (open->count == open->windows.size()) {
 		return;
 	}
+	CapturedWindow* window = &open->windows[open->count];
+	begin_window(window, open->next_sequence++, preroll_samples);
+	// Never close before the window ahead, so uploads and ring releases stay in order when the
+	// window length changes.
+	if (open->count > 0) {
+		const CapturedWindow& previous = open->windows[open->count - 1];
+		const uint64_t previous_end = previous.first_sample + previous.target_samples;
+		window->target_samples = static_cast<size_t>(std::max<uint64_t>(window->target_samples, previous_end - window->first_sample));
+	}
+	open->next_start = window->first_sample + window->preroll_samples + window->hop_samples;
+	++open->count;
+}
 
-	gpio_reset_pin(config->blink_gpio);
-	gpio_set_direction(config->blink_gpio, GPIO_MODE_OUTPUT);
+static void close_oldest(OpenWindows* open) {
+	const CapturedWindow& oldest = open->windows[0];
+	end_window(&open->windows[0], open->count > 1 ? open->windows[1].first_sample : oldest.first_sample + oldest.sample_count);
+	std::move(open->windows.begin() + 1, open->windows.begin() + open->count, open->windows.begin());
+	--open->count;
+}
+
+// Closes the oldest window once it reaches its length. Each window is captured at a single gain, so
+// while later windows overlap it, a gain step that is due closes them too, as short windows, and
+// the next window opens at the new gain. Without a step the peak restarts, so with overlap the AGC
+// looks at one hop of audio at a time.
+static void close_due_windows(OpenWindows* open) {
+#if CONFIG_MIC_AGC_ENABLE
+	if (open->count > 1) {
+		if (next_gain() == s_gain_log2) {
+			s_gain_peak = 0;
+		} else {
+			while (open->count > 1) {
+				close_oldest(open);
+			}
+		}
+	}
+#endif
+	close_oldest(open);
+}
+
+static void add_window_samples(CapturedWindow* window, const int16_t* samples, size_t count) {
+	for (size_t sample_index = 0; sample_index < count; ++sample_index) {
+		const int16_t pcm16_sample = samples[sample_index];
+		if (pcm16_sample < window->min_sample) {
+			window->min_sample = pcm16_sample;
+		}
+		if (pcm16_sample > window->max_sample) {
+			window->max_sample = pcm16_sample;
+		}
+		if (pcm16_sample != 0) {
+			++window->non_zero_samples;
+		}
+		const size_t window_index = window->sample_count + sample_index;
+		if (window_index < window->first_samples.size()) {
+			window->first_samples[window_index] = pcm16_sample;
+		}
+	}
+}
+
+// Converts raw I2S words into the ring at the upload rate, updating the stats of every open window.
+// Consumes input for at most max_output upload samples and returns how many input samples that took.
+static size_t store_samples(CapturedWindow* windows, size_t window_count, const int32_t* raw_samples, size_t sample_count, size_t max_output) {
+	// Keep draining I2S even when the upload task is behind; whatever does not fit in the
+	// ring is counted as lost to backpressure instead of stalling the DMA.
+	size_t writable = 0;
+	int16_t* ring_samples = audio_ring_reserve(&s_ring, &writable);
+	writable = std::min(writable, max_output);
 
-	static std::array<int16_t, BYTES_PER_UPLOAD / sizeof(int16_t)> audio_buffer = {};
-	std::array<int32_t, I2S_READ_CHUNK_BYTES / sizeof(int32_t)> i2s_read_buffer = {};
+	size_t input_count = 0;
+	size_t output_count = 0;
+	if (DECIMATION_FACTOR > 1) {
+		// Convert into a frame-sized scratch buffer and let the decimator write the filtered
+		// output straight into the ring.
+		std::array<int16_t, I2S_DMA_FRAME_NUM> pcm16_samples;
+		input_count = std::min({sample_count, pcm16_samples.size(), decimator_input_for_output(&s_decimator, max_output)});
+		convert_i2s_samples(raw_samples, input_count, pcm16_samples.data());
+		output_count = decimator_process(&s_decimator, pcm16_samples.data(), input_count, ring_samples, writable);
+	} else {
+		input_count = std::min(sample_count, max_output);
+		output_count = input_count;
+		convert_i2s_samples(raw_samples, std::min(input_count, writable), ring_samples);
+	}
 
-	ESP_LOGI(TAG, "Microphone task started");
+	const size_t samples_to_store = std::min(output_count, writable);
+	const uint32_t dropped = static_cast<uint32_t>(output_count - samples_to_store);
+	s_samples_dropped += dropped;
+#if CONFIG_MIC_VAD_ENABLE
+	const size_t active_frames = activity_detector_process(&s_activity, ring_samples, samples_to_store, s_gain_log2);
+#endif
+	const uint64_t chunk_start = audio_ring_head(&s_ring);
+	for (size_t index = 0; index < window_count; ++index) {
+		CapturedWindow* window = &windows[index];
+		window->samples_dropped += dropped;
+		add_window_samples(window, ring_samples, samples_to_store);
+#if CONFIG_MIC_DC_BLOCK_ENABLE
+		window->dc_offset = saturate_pcm16(dc_blocker_offset(&s_dc_blocker) >> MIC_EXTRA_BITS);
+#endif
+		window->sample_count += samples_to_store;
+#if CONFIG_MIC_VAD_ENABLE
+		window->active_frames += active_frames;
+		if (active_frames > 0) {
+			// The first active frame may have begun up to a frame before this chunk.
+			if (window->active_end == 0) {
+				const uint64_t frame_start = chunk_start - std::min<uint64_t>(chunk_start, s_activity.frame_samples);
+				window->active_begin = std::max(window->first_sample, frame_start);
+			}
+			window->active_end = chunk_start + samples_to_store;
+		}
+#endif
+	}
+	audio_ring_commit(&s_ring, samples_to_store);
+#if CONFIG_MIC_VAD_ENABLE
+	if (active_frames > 0) {
+		s_last_active_sample = chunk_start + samples_to_store;
+	}
+#endif
+	return input_count;
+}
+
+static void microphone_capture_task(void* pv_parameters) {
+	const MicUploaderConfig* config = static_cast<const MicUploaderConfig*>(pv_parameters);
+
+	ESP_LOGI(TAG, "Microphone capture task started");
 	ESP_LOGI(
 		TAG,
 		"I2S pin map BCLK=%d WS=%d DIN=%d L/R_SEL=%d level=%d",
@@ -161,98 +556,1219 @@ void microphone_uploader_task(void* pv_parameters) {
 		I2S_SELECT_LEVEL
 	);
 
+	static OpenWindows open = {};
+#if CONFIG_MIC_TRIGGER_ENABLE
+	bool capturing = false;
+#else
+	gpio_set_level(config->blink_gpio, 1);
+	open_window(&open, 0);
+#endif
+
 	while (true) {
-		gpio_set_level(config->blink_gpio, 1);
-		size_t total_samples_captured = 0;
-		int16_t min_sample = std::numeric_limits<int16_t>::max();
-		int16_t max_sample = std::numeric_limits<int16_t>::min();
-		size_t non_zero_samples = 0;
-		std::array<int16_t, 8> first_samples = {};
-		size_t first_samples_filled = 0;
-
-		while (total_samples_captured < audio_buffer.size()) {
-			size_t bytes_read = 0;
-			const size_t samples_remaining = audio_buffer.size() - total_samples_captured;
-			const size_t bytes_to_read = std::min(I2S_READ_CHUNK_BYTES, samples_remaining * I2S_READ_BYTES_PER_SAMPLE);
-
-			esp_err_t read_err = i2s_read(
-				I2S_PORT,
-				i2s_read_buffer.data(),
-				bytes_to_read,
-				&bytes_read,
-				pdMS_TO_TICKS(100)
-			);
-
-			if (read_err != ESP_OK) {
-				ESP_LOGE(TAG, "i2s_read failed: %s", esp_err_to_name(read_err));
+#if CONFIG_MIC_TRIGGER_ENABLE
+		// Without pre-roll, I2S stays off until the sound-level sensor fires. With pre-roll it keeps
+		// running into the ring, and only the radio waits for the trigger.
+		if (!capturing && PREROLL_SAMPLES == 0) {
+			if (!sound_trigger_wait(portMAX_DELAY) || start_i2s_capture() != ESP_OK) {
 				continue;
 			}
-
-			if (bytes_read == 0) {
-				ESP_LOGW(TAG, "i2s_read returned 0 bytes");
+			// The trigger may already have released; stop again so the next wait starts from idle.
+			if (!sound_trigger_active()) {
+				stop_i2s_capture();
 				continue;
 			}
+		}
+		if (!capturing && sound_trigger_active()) {
+			app_network_set_power_save(false);
+			capturing = true;
+			gpio_set_level(config->blink_gpio, 1);
+			open_window(&open, PREROLL_SAMPLES);
+		}
+#endif
 
-			const size_t samples_read = bytes_read / I2S_READ_BYTES_PER_SAMPLE;
-			if (samples_read == 0) {
-				ESP_LOGW(TAG, "i2s_read returned %u bytes (< one sample)", static_cast<unsigned>(bytes_read));
-				continue;
+		DmaFrame frame = {};
+		if (xQueueReceive(s_dma_frame_queue, &frame, pdMS_TO_TICKS(100)) != pdTRUE) {
+			ESP_LOGW(TAG, "No I2S DMA frame within 100 ms");
+			continue;
+		}
+
+#if CONFIG_MIC_TRIGGER_ENABLE
+		if (!capturing) {
+			// Idle: keep only the newest PREROLL_SAMPLES. Older audio is released once every
+			// window before it has been uploaded, so the pre-roll never frees a pending window.
+			CapturedWindow idle_window = {};
+			store_samples(&idle_window, 1, frame.samples, frame.sample_count, frame.sample_count);
+			const uint64_t head = audio_ring_head(&s_ring);
+			if (audio_ring_tail(&s_ring) >= s_last_window_end && head > PREROLL_SAMPLES) {
+				audio_ring_release(&s_ring, head - PREROLL_SAMPLES);
 			}
+			continue;
+		}
+#endif
+
+		// A DMA frame can straddle window boundaries; split it at each window's end and at the hop
+		// where the next window opens rather than bounding the read.
+		size_t consumed = 0;
+		while (consumed < frame.sample_count) {
+			const CapturedWindow& oldest = open.windows[0];
+			const CapturedWindow& newest = open.windows[open.count - 1];
+			const uint64_t head = newest.first_sample + newest.sample_count;
+			size_t samples_remaining = oldest.target_samples - oldest.sample_count;
+			if (open.count < open.windows.size() && open.next_start > head) {
+				samples_remaining = std::min<size_t>(samples_remaining, open.next_start - head);
+			}
+			consumed += store_samples(open.windows.data(), open.count, frame.samples + consumed, frame.sample_count - consumed, samples_remaining);
+
+			if (oldest.sample_count == oldest.target_samples) {
+				// Blink the LED off to mark the window boundary
+				gpio_set_level(config->blink_gpio, 0);
+				close_due_windows(&open);
+				gpio_set_level(config->blink_gpio, 1);
+			}
+			if (open.count == 0 || open.windows[open.count - 1].first_sample + open.windows[open.count - 1].sample_count >= open.next_start) {
+				open_window(&open, 0);
+			}
+		}
+#if CONFIG_MIC_UPLOAD_STREAMING
+		xTaskNotifyGive(s_upload_task);
+#endif
 
-			for (size_t sample_index = 0; sample_index < samples_read && total_samples_captured < audio_buffer.size(); ++sample_index) {
-				const int16_t pcm16_sample = convert_i2s_32_to_pcm16(i2s_read_buffer[sample_index]);
-				audio_buffer[total_samples_captured] = pcm16_sample;
-				if (pcm16_sample < min_sample) {
-					min_sample = pcm16_sample;
+#if CONFIG_MIC_TRIGGER_ENABLE
+		// On release the window in progress is closed early and uploaded as a short window.
+		if (!sound_trigger_active()) {
+			if (PREROLL_SAMPLES == 0) {
+				stop_i2s_capture();
+			}
+			gpio_set_level(config->blink_gpio, 0);
+			while (open.count > 0) {
+				close_oldest(&open);
+			}
+			app_network_set_power_save(true);
+			capturing = false;
+		}
+#endif
+	}
+}
+
+static void log_window_stats(const CapturedWindow& window) {
+	ESP_LOGI(
+		TAG,
+		"Window %u: captured %u bytes (%u samples, %u pre-roll), dropped=%u, dma_overruns=%u, non-zero samples=%u, min=%d, max=%d, dc=%d, gain=%d dB, active frames=%u, first=[%d,%d,%d,%d,%d,%d,%d,%d]",
+		static_cast<unsigned>(window.sequence),
+		static_cast<unsigned>(window.sample_count * PCM_BYTES_PER_SAMPLE),
+		static_cast<unsigned>(window.sample_count),
+		static_cast<unsigned>(window.preroll_samples),
+		static_cast<unsigned>(window.samples_dropped),
+		static_cast<unsigned>(s_dma_overruns),
+		static_cast<unsigned>(window.non_zero_samples),
+		window.min_sample,
+		window.max_sample,
+		window.dc_offset,
+		window.gain_log2 * 6,
+		static_cast<unsigned>(window.active_frames),
+		window.first_samples[0],
+		window.first_samples[1],
+		window.first_samples[2],
+		window.first_samples[3],
+		window.first_samples[4],
+		window.first_samples[5],
+		window.first_samples[6],
+		window.first_samples[7]
+	);
+}
+
+static size_t window_ms_to_samples(uint32_t window_ms) {
+	return static_cast<size_t>(static_cast<uint64_t>(UPLOAD_SAMPLE_RATE_HZ) * window_ms / 1000);
+}
+
+// Hop in samples for hop_ms against windows of window_samples. 0, or a hop as long as the window,
+// means back-to-back windows; shorter hops are raised until MAX_OPEN_WINDOWS cover a window.
+static size_t hop_ms_to_samples(uint32_t hop_ms, size_t window_samples) {
+#if CONFIG_MIC_UPLOAD_STREAMING
+	// A streamed window holds the connection until it ends, so streamed windows never overlap.
+	return window_samples;
+#else
+	const size_t hop_samples = window_ms_to_samples(hop_ms);
+	if (hop_samples == 0 || hop_samples >= window_samples) {
+		return window_samples;
+	}
+	return std::max(hop_samples, (window_samples + MAX_OPEN_WINDOWS - 1) / MAX_OPEN_WINDOWS);
+#endif
+}
+
+// Switches to the window length and hop the server sent with its last response, from the next
+// window on, and keeps them for the next boot. Lengths the capture pool cannot hold are ignored.
+static void apply_capture_settings(const HttpUploader* uploader) {
+	const uint32_t window_ms = uploader->window_ms;
+	const size_t window_samples = window_ms_to_samples(window_ms);
+	const bool fits = window_ms <= MAX_WINDOW_MS && window_samples > 0 && window_samples <= s_max_window_samples;
+	portENTER_CRITICAL(&s_settings_lock);
+	const bool window_changed = window_ms != 0 && window_ms != s_settings.window_ms && window_ms != s_ignored_window_ms;
+	const bool hop_changed = uploader->has_hop_ms && uploader->hop_ms != s_settings.hop_ms;
+	if (window_changed && fits) {
+		s_settings.window_ms = window_ms;
+	} else if (window_changed) {
+		s_ignored_window_ms = window_ms;
+	}
+	if (hop_changed) {
+		s_settings.hop_ms = uploader->hop_ms;
+	}
+	const bool applied = (window_changed && fits) || hop_changed;
+	if (applied) {
+		s_window_samples = window_ms_to_samples(s_settings.window_ms);
+		s_hop_samples = hop_ms_to_samples(s_settings.hop_ms, s_window_samples);
+	}
+	const CaptureSettings settings = s_settings;
+	portEXIT_CRITICAL(&s_settings_lock);
+
+	if (window_changed && !fits) {
+		ESP_LOGW(TAG, "Ignoring %u ms windows, the capture pool holds up to %u ms", static_cast<unsigned>(window_ms), static_cast<unsigned>(s_max_window_samples * 1000ULL / UPLOAD_SAMPLE_RATE_HZ));
+	}
+	if (!applied) {
+		return;
+	}
+	ESP_LOGI(TAG, "Windows set to %u ms, a new one every %u samples", static_cast<unsigned>(settings.window_ms), static_cast<unsigned>(s_hop_samples.load()));
+	capture_settings_store(&settings);
+}
+
+// Feeds the outcome of a request into the backoff shared by the live and drain connections.
+static UploadFailure record_upload_result(const HttpUploader* uploader, esp_err_t err) {
+	const UploadFailure failure = upload_failure_classify(err, uploader->last_status);
+	if (failure == UploadFailure::None) {
+		retry_backoff_success(&s_backoff);
+		apply_capture_settings(uploader);
+	} else if (upload_failure_retryable(failure)) {
+		const uint32_t delay_ms = retry_backoff_failure(&s_backoff, &RETRY_POLICY, uploader->retry_after_ms);
+		ESP_LOGW(TAG, "Upload failed (%s, %s), backing off for %u ms", upload_failure_name(failure), esp_err_to_name(err), static_cast<unsigned>(delay_ms));
+	} else {
+		ESP_LOGE(TAG, "Upload rejected with status %d, not retrying", uploader->last_status);
+	}
+	return failure;
+}
+
+#if CONFIG_MIC_SPOOL_ENABLE
+// Windows go to flash instead of the network while the link is down or backing off, or while
+// uploads have fallen so far behind capture that waiting on the network would cost audio.
+static bool should_spool(bool uploads_behind) {
+	return s_spool_ready && (uploads_behind || !app_network_is_connected() || retry_backoff_remaining_ms(&s_backoff) > 0);
+}
+#endif
+
+// Describes the part of the window from first_sample on. Only End events carry the final length
+// and stats; a streamed body is described by its Begin event.
+static ClipHeader make_clip_header(const CapturedWindow& window, uint64_t first_sample) {
+	ClipHeader header = {};
+	memcpy(header.magic, CLIP_HEADER_MAGIC, sizeof(header.magic));
+	header.version = CLIP_HEADER_VERSION;
+	header.codec = UPLOAD_CODEC;
+	header.header_size = sizeof(ClipHeader);
+	memcpy(header.device_mac, s_device_mac, sizeof(header.device_mac));
+	const uint64_t skipped = first_sample - window.first_sample;
+	header.capture_start_us = window.start_time_us > 0 ? window.start_time_us + samples_to_us(skipped) : 0;
+	header.sample_rate = UPLOAD_SAMPLE_RATE_HZ;
+	header.sequence = window.sequence;
+	if (window.event == WindowEvent::End && skipped == 0) {
+		header.flags = CLIP_FLAG_COMPLETE;
+		header.sample_count = static_cast<uint32_t>(window.sample_count);
+		header.min_sample = window.min_sample;
+		header.max_sample = window.max_sample;
+		header.non_zero_samples = static_cast<uint32_t>(window.non_zero_samples);
+		header.window_sample_count = static_cast<uint32_t>(window.sample_count);
+	}
+	if (window.window_samples > 0) {
+		header.flags |= CLIP_FLAG_TRIMMED;
+		header.window_offset = static_cast<uint32_t>(window.trim_offset);
+		header.window_sample_count = static_cast<uint32_t>(window.window_samples);
+	}
+	header.gain_log2 = window.gain_log2;
+	header.first_sample = first_sample;
+	header.stream_id = s_stream_id;
+	header.hop_samples = static_cast<uint32_t>(window.hop_samples);
+	return header;
+}
+
+// Tallies an upload decision in the current hour's slot and logs the previous hour on rollover.
+static void count_window(bool uploaded) {
+	const int64_t now_us = wall_clock_us();
+	const uint32_t hour = static_cast<uint32_t>((now_us > 0 ? now_us : esp_timer_get_time()) / (3600LL * 1000000));
+
+	WindowHourStats finished = {};
+	portENTER_CRITICAL(&s_hourly_lock);
+	if (hour != s_current_hour) {
+		finished = s_hourly[s_current_hour % MIC_STATS_HOURS];
+		s_current_hour = hour;
+		s_hourly[hour % MIC_STATS_HOURS] = {.hour = hour, .windows_uploaded = 0, .windows_suppressed = 0};
+	}
+	WindowHourStats& slot = s_hourly[hour % MIC_STATS_HOURS];
+	if (uploaded) {
+		++slot.windows_uploaded;
+	} else {
+		++slot.windows_suppressed;
+	}
+	portEXIT_CRITICAL(&s_hourly_lock);
+
+	if (finished.windows_uploaded + finished.windows_suppressed > 0) {
+		ESP_LOGI(
+			TAG,
+			"Hour %u: %u windows uploaded, %u suppressed",
+			static_cast<unsigned>(finished.hour),
+			static_cast<unsigned>(finished.windows_uploaded),
+			static_cast<unsigned>(finished.windows_suppressed)
+		);
+		power_manager_log_stats();
+	}
+}
+
+static bool window_is_active(const CapturedWindow& window) {
+#if CONFIG_MIC_VAD_ENABLE
+	return window.active_frames > 0;
+#else
+	return true;
+#endif
+}
+
+#if CONFIG_MIC_CLASSIFIER_ENABLE
+// Runs the classifier over an active window. Without a model every window passes.
+static bool window_has_bird(const CapturedWindow& window) {
+	if (!bird_classifier_ready()) {
+		return true;
+	}
+	bird_classifier_begin(window.gain_log2);
+	uint64_t position = window.first_sample;
+	const uint64_t window_end = window.first_sample + window.sample_count;
+	while (position < window_end) {
+		size_t contiguous = 0;
+		const int16_t* samples = audio_ring_peek(&s_ring, position, &contiguous);
+		const size_t count = static_cast<size_t>(std::min<uint64_t>(contiguous, window_end - position));
+		bird_classifier_write(samples, count);
+		position += count;
+	}
+	const uint8_t score = bird_classifier_finish();
+	BirdClassifierStats stats = {};
+	bird_classifier_get_stats(&stats);
+	ESP_LOGI(
+		TAG,
+		"Window %u: bird score %u%%, invoke %u us (max %u us)",
+		static_cast<unsigned>(window.sequence),
+		static_cast<unsigned>(score),
+		static_cast<unsigned>(stats.last_invoke_us),
+		static_cast<unsigned>(stats.max_invoke_us)
+	);
+	const bool bird = score >= CONFIG_MIC_CLASSIFIER_THRESHOLD_PCT;
+	bird_classifier_count(!bird);
+	return bird;
+}
+#endif
+
+#if CONFIG_MIC_TRIM_ENABLE
+// Cuts a window down to its active span, padded on both sides and grown around its centre to whole
+// analysis segments. The span was tracked during capture, so only the window bounds change.
+static CapturedWindow trim_window(const CapturedWindow& window) {
+	const uint64_t window_end = window.first_sample + window.sample_count;
+	const uint64_t begin = window.active_begin - std::min<uint64_t>(window.active_begin - window.first_sample, TRIM_PADDING_SAMPLES);
+	const uint64_t end = std::min(window_end, window.active_end + TRIM_PADDING_SAMPLES);
+	const uint64_t length = (end - begin + TRIM_SEGMENT_SAMPLES - 1) / TRIM_SEGMENT_SAMPLES * TRIM_SEGMENT_SAMPLES;
+	if (length >= window.sample_count) {
+		return window;
+	}
+	// Slide the segments back inside the window where the centred span would cross an edge.
+	uint64_t first_sample = begin - std::min<uint64_t>(begin - window.first_sample, (length - (end - begin)) / 2);
+	first_sample = std::min(first_sample, window_end - length);
+
+	CapturedWindow trimmed = window;
+	trimmed.first_sample = first_sample;
+	trimmed.sample_count = static_cast<size_t>(length);
+	trimmed.trim_offset = static_cast<size_t>(first_sample - window.first_sample);
+	trimmed.window_samples = window.sample_count;
+	trimmed.start_time_us = window.start_time_us > 0 ? window.start_time_us + samples_to_us(trimmed.trim_offset) : 0;
+	ESP_LOGI(
+		TAG,
+		"Window %u: uploading %u of %u samples from +%u",
+		static_cast<unsigned>(window.sequence),
+		static_cast<unsigned>(trimmed.sample_count),
+		static_cast<unsigned>(window.sample_count),
+		static_cast<unsigned>(trimmed.trim_offset)
+	);
+	return trimmed;
+}
+#endif
+
+#if CONFIG_MIC_UPLOAD_STREAMING
+// Whether capture has completed an active frame since first_sample.
+static bool activity_since(uint64_t first_sample) {
+#if CONFIG_MIC_VAD_ENABLE
+	return s_last_active_sample > first_sample;
+#else
+	return true;
+#endif
+}
+#endif
+
+// Drops a window the activity detector found silent or the classifier rejected. Instead of the
+// audio, a heartbeat with the number of windows held back goes out at most once per heartbeat
+// interval; it is not spooled, and the count carries over to the next one if the server cannot be
+// reached.
+static void suppress_window(const CapturedWindow& window) {
+	++s_windows_suppressed;
+	count_window(false);
+#if CONFIG_MIC_VAD_ENABLE
+	s_heartbeat_windows += 1;
+	s_heartbeat_samples += static_cast<uint32_t>(window.sample_count);
+	const int64_t now_us = esp_timer_get_time();
+	if (s_last_heartbeat_us != 0 && now_us - s_last_heartbeat_us < CONFIG_MIC_VAD_HEARTBEAT_S * 1000000LL) {
+		return;
+	}
+	if (retry_backoff_remaining_ms(&s_backoff) > 0 || !app_network_is_connected()) {
+		return;
+	}
+
+	ClipHeader header = make_clip_header(window, window.first_sample);
+	header.flags |= CLIP_FLAG_HEARTBEAT;
+	const ClipHeartbeat heartbeat = {
+		.windows_suppressed = s_heartbeat_windows,
+		.samples_suppressed = s_heartbeat_samples,
+	};
+	const HttpBodySegment segments[] = {
+		{reinterpret_cast<const uint8_t*>(&header), sizeof(header)},
+		{reinterpret_cast<const uint8_t*>(&heartbeat), sizeof(heartbeat)},
+	};
+	if (record_upload_result(&s_http_uploader, http_uploader_post(&s_http_uploader, segments, 2)) == UploadFailure::None) {
+		ESP_LOGI(TAG, "Heartbeat sent, %u silent windows since the last one", static_cast<unsigned>(s_heartbeat_windows));
+		s_heartbeat_windows = 0;
+		s_heartbeat_samples = 0;
+		s_last_heartbeat_us = now_us;
+	}
+#endif
+}
+
+#if CONFIG_MIC_UPLOAD_STREAMING || CONFIG_MIC_UPLOAD_CODEC_FLAC || CONFIG_MIC_SPOOL_ENABLE
+enum class BodyTarget : uint8_t {
+	Http,
+	Spool,
+};
+
+static BodyTarget s_body_target = BodyTarget::Http;
+
+static esp_err_t body_write(const uint8_t* data, size_t length) {
+	if (s_body_target == BodyTarget::Spool) {
+		return clip_queue_append(&s_clip_queue, data, length);
+	}
+	return http_uploader_stream_write(&s_http_uploader, data, length);
+}
+
+static void body_abort() {
+	if (s_body_target == BodyTarget::Spool) {
+		clip_queue_abort(&s_clip_queue);
+	} else {
+		http_uploader_stream_abort(&s_http_uploader);
+	}
+}
+
+#if CONFIG_MIC_UPLOAD_CODEC_FLAC || CONFIG_MIC_UPLOAD_CODEC_LOG_MEL
+static esp_err_t write_encoder_output(const uint8_t* data, size_t length, void* user_ctx) {
+	return body_write(data, length);
+}
+#endif
+
+// Starts an upload body, either a chunked POST or a clip in the flash queue, and writes its clip
+// header.
+static esp_err_t body_start(BodyTarget target, const ClipHeader& header) {
+	s_body_target = target;
+	esp_err_t err = target == BodyTarget::Spool ? clip_queue_begin(&s_clip_queue) : http_uploader_stream_open(&s_http_uploader);
+	if (err != ESP_OK) {
+		return err;
+	}
+	err = body_write(reinterpret_cast<const uint8_t*>(&header), sizeof(header));
+	if (err != ESP_OK) {
+		body_abort();
+	}
+	return err;
+}
+
+// Starts a body that is encoded as it is written, restarting the encoder. total_samples is 0 while
+// the length is unknown.
+static esp_err_t body_open(BodyTarget target, const ClipHeader& header, uint64_t total_samples) {
+	esp_err_t err = body_start(target, header);
+	if (err != ESP_OK) {
+		return err;
+	}
+#if CONFIG_MIC_UPLOAD_CODEC_IMA_ADPCM
+	adpcm_encoder_reset(&s_adpcm_encoder);
+#elif CONFIG_MIC_UPLOAD_CODEC_FLAC
+	err = flac_encoder_begin(&s_flac_encoder, UPLOAD_SAMPLE_RATE_HZ, total_samples, write_encoder_output, nullptr);
+#elif CONFIG_MIC_UPLOAD_CODEC_LOG_MEL
+	err = log_mel_encoder_begin(&s_log_mel_encoder, write_encoder_output, nullptr);
+#endif
+	if (err != ESP_OK) {
+		body_abort();
+	}
+	return err;
+}
+
+// Writes ring samples to the open body in the upload encoding.
+static esp_err_t body_write_samples(const int16_t* samples, size_t count) {
+#if CONFIG_MIC_UPLOAD_CODEC_FLAC
+	return flac_encoder_write(&s_flac_encoder, samples, count, write_encoder_output, nullptr);
+#elif CONFIG_MIC_UPLOAD_CODEC_LOG_MEL
+	return log_mel_encoder_write(&s_log_mel_encoder, samples, count, write_encoder_output, nullptr);
+#elif CONFIG_MIC_UPLOAD_CODEC_IMA_ADPCM
+	std::array<uint8_t, 256> encoded;
+	while (count > 0) {
+		const size_t batch = std::min(count, encoded.size() * 2);
+		const size_t encoded_bytes = adpcm_encoder_encode(&s_adpcm_encoder, samples, batch, encoded.data());
+		esp_err_t err = body_write(encoded.data(), encoded_bytes);
+		if (err != ESP_OK) {
+			return err;
+		}
+		samples += batch;
+		count -= batch;
+	}
+	return ESP_OK;
+#else
+	return body_write(reinterpret_cast<const uint8_t*>(samples), count * PCM_BYTES_PER_SAMPLE);
+#endif
+}
+
+static esp_err_t body_finish() {
+	esp_err_t err = ESP_OK;
+#if CONFIG_MIC_UPLOAD_CODEC_IMA_ADPCM
+	uint8_t last_byte = 0;
+	if (adpcm_encoder_flush(&s_adpcm_encoder, &last_byte) > 0) {
+		err = body_write(&last_byte, 1);
+	}
+#elif CONFIG_MIC_UPLOAD_CODEC_FLAC
+	err = flac_encoder_finish(&s_flac_encoder, write_encoder_output, nullptr);
+#endif
+	if (err != ESP_OK) {
+		body_abort();
+		return err;
+	}
+	if (s_body_target == BodyTarget::Http) {
+		return http_uploader_stream_finish(&s_http_uploader);
+	}
+
+	err = clip_queue_commit(&s_clip_queue);
+	if (err == ESP_OK) {
+		ClipQueueStats spool = {};
+		clip_queue_get_stats(&s_clip_queue, &spool);
+		ESP_LOGI(TAG, "Spooled window to flash, %u clips (%u bytes) pending", static_cast<unsigned>(spool.clips_pending), static_cast<unsigned>(spool.bytes_pending));
+		xTaskNotifyGive(s_drain_task);
+	}
+	return err;
+}
+#endif
+
+#if CONFIG_MIC_UPLOAD_STREAMING
+// Live request outcomes drive the backoff; spool writes only need logging.
+static esp_err_t check_body_result(BodyTarget target, esp_err_t err) {
+	if (target == BodyTarget::Http) {
+		record_upload_result(&s_http_uploader, err);
+	} else {
+		ESP_ERROR_CHECK_WITHOUT_ABORT(err);
+	}
+	return err;
+}
+
+// Writes the window to a chunked POST as capture commits it, releasing ring space behind the
+// write position. Returns once the window's End event has been received and flushed. With the
+// spool enabled, a stream that fails or cannot keep up with capture is closed and the rest of the
+// window is written to flash instead; audio the failed request already carried is lost. Without
+// the spool, a window that starts while the server is backed off is discarded. With the activity
+// detector, the body is not opened until the window shows activity or the ring runs short of room
+// to keep waiting; a window that ends without any is suppressed.
+static void stream_window(const CapturedWindow& begin) {
+	BodyTarget target = BodyTarget::Http;
+	bool opened = false;
+	bool body_ok = false;
+	uint64_t written = begin.first_sample;
+
+	while (true) {
+		// Sample the head before polling for End: capture queues End before it commits any sample
+		// of the next window, so an empty queue means head is still inside this window.
+		const uint64_t head = audio_ring_head(&s_ring);
+		CapturedWindow end = {};
+		const bool window_complete = xQueueReceive(s_window_queue, &end, 0) == pdTRUE;
+		const uint64_t limit = window_complete ? end.first_sample + end.sample_count : head;
+
+		if (!opened) {
+			const bool ring_low = audio_ring_free(&s_ring) < s_ring_capacity / 4;
+			const bool active = window_complete ? window_is_active(end) : activity_since(begin.first_sample);
+			if (window_complete && !active) {
+				audio_ring_release(&s_ring, limit);
+				log_window_stats(end);
+				suppress_window(end);
+				return;
+			}
+			if (active || ring_low) {
+				opened = true;
+				count_window(true);
+#if CONFIG_MIC_SPOOL_ENABLE
+				if (should_spool(ring_low)) {
+					target = BodyTarget::Spool;
 				}
-				if (pcm16_sample > max_sample) {
-					max_sample = pcm16_sample;
+#endif
+				if (target == BodyTarget::Http && retry_backoff_remaining_ms(&s_backoff) > 0) {
+					ESP_LOGW(TAG, "Upload backing off, discarding window %u", static_cast<unsigned>(begin.sequence));
+				} else {
+					body_ok = check_body_result(target, body_open(target, make_clip_header(begin, written), 0)) == ESP_OK;
 				}
-				if (pcm16_sample != 0) {
-					++non_zero_samples;
+			}
+		}
+
+		while (opened && written < limit) {
+#if CONFIG_MIC_SPOOL_ENABLE
+			if (target == BodyTarget::Http && should_spool(!body_ok || audio_ring_free(&s_ring) < s_ring_capacity / 4)) {
+				if (body_ok) {
+					check_body_result(target, body_finish());
 				}
-				if (first_samples_filled < first_samples.size()) {
-					first_samples[first_samples_filled] = pcm16_sample;
-					++first_samples_filled;
+				target = BodyTarget::Spool;
+				body_ok = check_body_result(target, body_open(target, make_clip_header(begin, written), 0)) == ESP_OK;
+			}
+#endif
+			size_t contiguous = 0;
+			const int16_t* samples = audio_ring_peek(&s_ring, written, &contiguous);
+			const size_t count = static_cast<size_t>(std::min<uint64_t>(contiguous, limit - written));
+			esp_err_t write_err = body_ok ? body_write_samples(samples, count) : ESP_OK;
+			if (write_err != ESP_OK) {
+				body_abort();
+				check_body_result(target, write_err);
+				body_ok = false;
+				if (target == BodyTarget::Http) {
+					// Retried against the spool, if there is one, at the top of the loop.
+					continue;
 				}
-				++total_samples_captured;
 			}
+			written += count;
+			audio_ring_release(&s_ring, written);
+		}
+
+		if (window_complete) {
+			log_window_stats(end);
+			if (body_ok && check_body_result(target, body_finish()) == ESP_OK && target == BodyTarget::Http) {
+				++s_windows_uploaded;
+			}
+			return;
+		}
+
+		// Capture alone does not need the boost, so it is dropped while waiting for more samples.
+		power_manager_boost_end();
+		ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+		power_manager_boost_begin();
+	}
+}
+#else
+#if CONFIG_MIC_UPLOAD_CODEC_FLAC
+// Encoded frame sizes are only known once written, so a lossless window goes out as a chunked body
+// encoded straight from the ring one block at a time.
+static esp_err_t write_window_body(BodyTarget target, const CapturedWindow& window) {
+	esp_err_t err = body_open(target, make_clip_header(window, window.first_sample), window.sample_count);
+	uint64_t position = window.first_sample;
+	const uint64_t window_end = window.first_sample + window.sample_count;
+	while (err == ESP_OK && position < window_end) {
+		size_t contiguous = 0;
+		const int16_t* samples = audio_ring_peek(&s_ring, position, &contiguous);
+		const size_t count = static_cast<size_t>(std::min<uint64_t>(contiguous, window_end - position));
+		err = body_write_samples(samples, count);
+		if (err != ESP_OK) {
+			body_abort();
+		}
+		position += count;
+	}
+	return err == ESP_OK ? body_finish() : err;
+}
+#elif CONFIG_MIC_UPLOAD_CODEC_IMA_ADPCM
+// Encodes the whole window out of the ring so its slot can be released before the upload starts.
+static size_t encode_window(const CapturedWindow& window, uint8_t* output) {
+	adpcm_encoder_reset(&s_adpcm_encoder);
+	size_t encoded_bytes = 0;
+	uint64_t position = window.first_sample;
+	const uint64_t window_end = window.first_sample + window.sample_count;
+	while (position < window_end) {
+		size_t contiguous = 0;
+		const int16_t* samples = audio_ring_peek(&s_ring, position, &contiguous);
+		const size_t count = static_cast<size_t>(std::min<uint64_t>(contiguous, window_end - position));
+		encoded_bytes += adpcm_encoder_encode(&s_adpcm_encoder, samples, count, output + encoded_bytes);
+		position += count;
+	}
+	encoded_bytes += adpcm_encoder_flush(&s_adpcm_encoder, output + encoded_bytes);
+	audio_ring_release(&s_ring, window.release_sample);
+	return encoded_bytes;
+}
+#elif CONFIG_MIC_UPLOAD_CODEC_LOG_MEL
+struct FeatureBuffer {
+	uint8_t* data;
+	size_t length;
+};
+
+static esp_err_t append_features(const uint8_t* data, size_t length, void* user_ctx) {
+	FeatureBuffer* buffer = static_cast<FeatureBuffer*>(user_ctx);
+	if (buffer->length + length > s_encoded_capacity) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+	memcpy(buffer->data + buffer->length, data, length);
+	buffer->length += length;
+	return ESP_OK;
+}
+
+// Computes the window's features out of the ring so its slot can be released before the upload
+// starts.
+static size_t encode_window(const CapturedWindow& window, uint8_t* output) {
+	FeatureBuffer buffer = {output, 0};
+	esp_err_t err = log_mel_encoder_begin(&s_log_mel_encoder, append_features, &buffer);
+	uint64_t position = window.first_sample;
+	const uint64_t window_end = window.first_sample + window.sample_count;
+	while (err == ESP_OK && position < window_end) {
+		size_t contiguous = 0;
+		const int16_t* samples = audio_ring_peek(&s_ring, position, &contiguous);
+		const size_t count = static_cast<size_t>(std::min<uint64_t>(contiguous, window_end - position));
+		err = log_mel_encoder_write(&s_log_mel_encoder, samples, count, append_features, &buffer);
+		position += count;
+	}
+	ESP_ERROR_CHECK_WITHOUT_ABORT(err);
+	audio_ring_release(&s_ring, window.release_sample);
+	return buffer.length;
+}
+#endif
+
+#if CONFIG_MIC_SPOOL_ENABLE && !CONFIG_MIC_UPLOAD_CODEC_FLAC
+// Copies an already encoded body, without its clip header, into the flash queue.
+static esp_err_t spool_segments(const ClipHeader& header, const HttpBodySegment* segments, size_t segment_count) {
+	esp_err_t err = body_start(BodyTarget::Spool, header);
+	for (size_t index = 0; index < segment_count && err == ESP_OK; ++index) {
+		err = body_write(segments[index].data, segments[index].length);
+		if (err != ESP_OK) {
+			body_abort();
+		}
+	}
+	return err == ESP_OK ? body_finish() : err;
+}
+#endif
+
+// One live attempt at the window, already laid out in segments unless the codec encodes on the fly.
+static esp_err_t send_window(const CapturedWindow& window, const HttpBodySegment* segments, size_t segment_count) {
+	ESP_LOGI(TAG, "Uploading audio payload");
+#if CONFIG_MIC_UPLOAD_CODEC_FLAC
+	return write_window_body(BodyTarget::Http, window);
+#else
+	return http_uploader_post(&s_http_uploader, segments, segment_count);
+#endif
+}
+
+// Uploads the window once the backoff allows. With the spool, the first failure hands the window
+// to the drain task, which owns the retries. Without it, the window is retried here for as long
+// as the ring still has a window of room, so capture never waits on the server.
+static UploadFailure upload_with_retry(const CapturedWindow& window, const HttpBodySegment* segments, size_t segment_count) {
+	for (uint32_t attempt = 1;; ++attempt) {
+		while (retry_backoff_remaining_ms(&s_backoff) > 0) {
+			if (s_spool_ready || audio_ring_free(&s_ring) < s_window_samples) {
+				return UploadFailure::Deferred;
+			}
+			vTaskDelay(pdMS_TO_TICKS(100));
+		}
+
+		const UploadFailure failure = record_upload_result(&s_http_uploader, send_window(window, segments, segment_count));
+		if (!upload_failure_retryable(failure) || s_spool_ready || attempt >= RETRY_POLICY.max_attempts || audio_ring_free(&s_ring) < s_window_samples) {
+			return failure;
 		}
+	}
+}
+
+static void upload_window(const CapturedWindow& captured) {
+	size_t total_bytes_read = captured.sample_count * PCM_BYTES_PER_SAMPLE;
+	size_t min_upload_length_bytes = MILLISECONDS_TO_BYTES_PCM16(0); // Minimum upload length of 3 seconds
+	if (total_bytes_read == 0 || total_bytes_read < min_upload_length_bytes) {
+		ESP_LOGW(TAG, "Captured audio is too short (%u bytes), skipping upload", static_cast<unsigned>(total_bytes_read));
+		return;
+	}
+
+	log_window_stats(captured);
+	if (!window_is_active(captured)) {
+		suppress_window(captured);
+		return;
+	}
+#if CONFIG_MIC_TRIM_ENABLE
+	const CapturedWindow window = trim_window(captured);
+#else
+	const CapturedWindow& window = captured;
+#endif
+#if CONFIG_MIC_CLASSIFIER_ENABLE
+	if (!window_has_bird(window)) {
+		suppress_window(captured);
+		return;
+	}
+#endif
+	count_window(true);
 
-		ESP_LOGI(TAG, "Finished monitoring sound level, preparing to upload audio");
+#if CONFIG_MIC_SPOOL_ENABLE
+	// A whole window captured since this one ended means uploads are not keeping up.
+	const uint64_t captured_since = audio_ring_head(&s_ring) - (captured.first_sample + captured.sample_count);
+	const bool spool_first = should_spool(captured_since >= s_window_samples);
+#else
+	const bool spool_first = false;
+#endif
 
-		// Turn off LED to indicate we are done listening
-		gpio_set_level(config->blink_gpio, 0);
+	// The clip header goes out as the first body segment.
+	const ClipHeader header = make_clip_header(window, window.first_sample);
+	std::array<HttpBodySegment, 3> segments = {};
+	segments[0].data = reinterpret_cast<const uint8_t*>(&header);
+	segments[0].length = sizeof(header);
+	size_t segment_count = 1;
+#if CONFIG_MIC_UPLOAD_CODEC_IMA_ADPCM || CONFIG_MIC_UPLOAD_CODEC_LOG_MEL
+	segments[1].data = s_encoded;
+	segments[1].length = encode_window(window, s_encoded);
+	segment_count = 2;
+#elif !CONFIG_MIC_UPLOAD_CODEC_FLAC
+	// A window that wraps the end of the ring goes out as two body segments.
+	uint64_t position = window.first_sample;
+	const uint64_t window_end = window.first_sample + window.sample_count;
+	while (position < window_end) {
+		size_t contiguous = 0;
+		const int16_t* samples = audio_ring_peek(&s_ring, position, &contiguous);
+		const size_t count = static_cast<size_t>(std::min<uint64_t>(contiguous, window_end - position));
+		segments[segment_count].data = reinterpret_cast<const uint8_t*>(samples);
+		segments[segment_count].length = count * PCM_BYTES_PER_SAMPLE;
+		++segment_count;
+		position += count;
+	}
+#endif
 
-		size_t total_bytes_read = total_samples_captured * PCM_BYTES_PER_SAMPLE;
-		size_t min_upload_length_bytes = MILLISECONDS_TO_BYTES_PCM16(0); // Minimum upload length of 3 seconds
-		if (total_bytes_read < min_upload_length_bytes) {
-			ESP_LOGW(TAG, "Captured audio is too short (%u bytes), skipping upload", static_cast<unsigned>(total_bytes_read));
+	const UploadFailure failure = spool_first ? UploadFailure::Deferred : upload_with_retry(window, segments.data(), segment_count);
+	if (failure == UploadFailure::None) {
+		++s_windows_uploaded;
+		return;
+	}
+#if CONFIG_MIC_SPOOL_ENABLE
+	// A rejected body would be rejected again on replay.
+	if (failure != UploadFailure::Rejected && s_spool_ready) {
+#if CONFIG_MIC_UPLOAD_CODEC_FLAC
+		ESP_ERROR_CHECK_WITHOUT_ABORT(write_window_body(BodyTarget::Spool, window));
+#else
+		ESP_ERROR_CHECK_WITHOUT_ABORT(spool_segments(header, segments.data() + 1, segment_count - 1));
+#endif
+		return;
+	}
+#endif
+	ESP_LOGW(TAG, "Window %u not uploaded (%s), dropping", static_cast<unsigned>(window.sequence), upload_failure_name(failure));
+}
+#endif
+
+#if CONFIG_MIC_SPOOL_ENABLE
+// Streams one spooled clip to the server, checking it against the CRC recorded when it was stored.
+static esp_err_t replay_clip(const ClipInfo& clip) {
+	static std::array<uint8_t, 2048> chunk;
+	esp_err_t err = http_uploader_stream_open(&s_drain_uploader);
+	if (err != ESP_OK) {
+		return err;
+	}
+
+	uint32_t crc = 0;
+	for (size_t offset = 0; err == ESP_OK && offset < clip.length; offset += chunk.size()) {
+		const size_t length = std::min(chunk.size(), clip.length - offset);
+		err = clip_queue_read(&s_clip_queue, &clip, offset, chunk.data(), length);
+		if (err == ESP_OK) {
+			crc = esp_rom_crc32_le(crc, chunk.data(), length);
+			err = http_uploader_stream_write(&s_drain_uploader, chunk.data(), length);
+		}
+	}
+	if (err == ESP_OK && crc != clip.crc) {
+		err = ESP_ERR_INVALID_CRC;
+	}
+	if (err != ESP_OK) {
+		http_uploader_stream_abort(&s_drain_uploader);
+		return err;
+	}
+	return http_uploader_stream_finish(&s_drain_uploader);
+}
+
+// Replays spooled clips oldest first, at most one per drain interval, on its own connection so
+// live uploads are never held up behind the backlog. Failed replays wait out the shared backoff,
+// and a clip that keeps failing is dropped once it has used up its attempts.
+static void microphone_drain_task(void* pv_parameters) {
+	ESP_LOGI(TAG, "Spool drain task started");
+	uint32_t attempts_sequence = 0;
+	uint32_t attempts = 0;
+
+	while (true) {
+		ClipInfo clip = {};
+		if (!clip_queue_peek(&s_clip_queue, &clip)) {
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 			continue;
 		}
+		const uint32_t backoff_ms = retry_backoff_remaining_ms(&s_backoff);
+		if (backoff_ms > 0) {
+			vTaskDelay(pdMS_TO_TICKS(backoff_ms));
+			continue;
+		}
+		if (!app_network_is_connected()) {
+			vTaskDelay(pdMS_TO_TICKS(CONFIG_MIC_SPOOL_RETRY_MS));
+			continue;
+		}
+		if (clip.sequence != attempts_sequence) {
+			attempts_sequence = clip.sequence;
+			attempts = 0;
+		}
 
-		// const int16_t removed_dc = remove_dc_offset(audio_buffer.data(), total_samples_captured);
-		const int16_t removed_dc = 0;
+		power_manager_boost_begin();
+		esp_err_t err = replay_clip(clip);
+		power_manager_boost_end();
+		if (err == ESP_ERR_INVALID_STATE) {
+			// Overwritten by capture while it was being sent; move on to the new oldest clip.
+			continue;
+		}
+		if (err == ESP_ERR_INVALID_CRC) {
+			ESP_LOGE(TAG, "Clip %u is corrupt, discarding", static_cast<unsigned>(clip.sequence));
+		} else {
+			const UploadFailure failure = record_upload_result(&s_drain_uploader, err);
+			if (upload_failure_retryable(failure)) {
+				// An unreachable server says nothing about the clip, so it does not use up an attempt.
+				if (failure != UploadFailure::Connect) {
+					++attempts;
+				}
+				if (attempts < RETRY_POLICY.max_attempts) {
+					continue;
+				}
+				ESP_LOGE(TAG, "Clip %u failed %u times, discarding", static_cast<unsigned>(clip.sequence), static_cast<unsigned>(attempts));
+			} else if (failure == UploadFailure::Rejected) {
+				ESP_LOGE(TAG, "Clip %u rejected by the server, discarding", static_cast<unsigned>(clip.sequence));
+			}
+		}
+		clip_queue_pop(&s_clip_queue, &clip);
+		ClipQueueStats spool = {};
+		clip_queue_get_stats(&s_clip_queue, &spool);
 		ESP_LOGI(
 			TAG,
-			"Captured %u bytes (%u samples), non-zero samples=%u, min=%d, max=%d, dc=%d, first=[%d,%d,%d,%d,%d,%d,%d,%d]",
-			static_cast<unsigned>(total_bytes_read),
-			static_cast<unsigned>(total_samples_captured),
-			static_cast<unsigned>(non_zero_samples),
-			min_sample,
-			max_sample,
-			removed_dc,
-			first_samples[0],
-			first_samples[1],
-			first_samples[2],
-			first_samples[3],
-			first_samples[4],
-			first_samples[5],
-			first_samples[6],
-			first_samples[7]
+			"Replayed clip %u, %u clips (%u bytes) pending, replayed=%u, overwritten=%u",
+			static_cast<unsigned>(clip.sequence),
+			static_cast<unsigned>(spool.clips_pending),
+			static_cast<unsigned>(spool.bytes_pending),
+			static_cast<unsigned>(spool.clips_replayed),
+			static_cast<unsigned>(spool.clips_overwritten)
+		);
+		vTaskDelay(pdMS_TO_TICKS(CONFIG_MIC_SPOOL_DRAIN_INTERVAL_MS));
+	}
+}
+#endif
+
+// Every request says how its body is encoded, so replayed clips are decoded like live ones.
+static void set_upload_headers(HttpUploader* uploader) {
+	static char sample_rate_header[12];
+	snprintf(sample_rate_header, sizeof(sample_rate_header), "%d", UPLOAD_SAMPLE_RATE_HZ);
+	ESP_ERROR_CHECK_WITHOUT_ABORT(http_uploader_set_header(uploader, "X-Audio-Encoding", UPLOAD_ENCODING));
+	ESP_ERROR_CHECK_WITHOUT_ABORT(http_uploader_set_header(uploader, "X-Sample-Rate", sample_rate_header));
+}
+
+static void microphone_upload_task(void* pv_parameters) {
+	ESP_LOGI(TAG, "Microphone upload task started");
+
+	while (true) {
+		CapturedWindow window = {};
+		if (xQueueReceive(s_window_queue, &window, portMAX_DELAY) != pdTRUE) {
+			continue;
+		}
+
+#if CONFIG_MIC_UPLOAD_STREAMING
+		if (window.event == WindowEvent::Begin) {
+			power_manager_boost_begin();
+			stream_window(window);
+			power_manager_boost_end();
+		}
+#else
+		// The classifier, encoder and TLS are the only heavy work, so they run at full clock.
+		if (window.event == WindowEvent::End) {
+			power_manager_boost_begin();
+			upload_window(window);
+			power_manager_boost_end();
+			audio_ring_release(&s_ring, window.release_sample);
+		}
+#endif
+	}
+}
+
+#if !CONFIG_MIC_UPLOAD_STREAMING
+// Bytes of the encode buffer for windows of up to window_samples.
+static size_t encoded_window_bytes(size_t window_samples) {
+#if CONFIG_MIC_UPLOAD_CODEC_IMA_ADPCM
+	return (window_samples + PREROLL_SAMPLES + 1) / 2;
+#elif CONFIG_MIC_UPLOAD_CODEC_LOG_MEL
+	// A frame for every hop the window spans.
+	return sizeof(ClipLogMel) + ((window_samples + PREROLL_SAMPLES) / CONFIG_MIC_MEL_HOP_SAMPLES + 1) * CONFIG_MIC_MEL_BANDS;
+#else
+	return 0;
+#endif
+}
+
+// Pool bytes the ring and encode buffer take for windows of up to window_samples, rounded as
+// capture_pool_alloc rounds them.
+static size_t window_buffer_bytes(size_t window_samples) {
+	const size_t ring_bytes = (window_samples * WINDOW_SLOTS + PREROLL_SAMPLES) * PCM_BYTES_PER_SAMPLE;
+	return ((ring_bytes + 3) & ~static_cast<size_t>(3)) + ((encoded_window_bytes(window_samples) + 3) & ~static_cast<size_t>(3));
+}
+
+// Longest window whose buffers fit the pool.
+static size_t max_window_samples(size_t pool_bytes) {
+	size_t low = 0;
+	size_t high = pool_bytes / PCM_BYTES_PER_SAMPLE;
+	while (low < high) {
+		const size_t middle = (low + high + 1) / 2;
+		if (window_buffer_bytes(middle) <= pool_bytes) {
+			low = middle;
+		} else {
+			high = middle - 1;
+		}
+	}
+	return low;
+}
+#endif
+
+// Loads the window length and carves the ring and encode buffer out of the capture pool.
+static esp_err_t init_capture_buffers() {
+	capture_settings_load(&s_settings);
+#if CONFIG_MIC_UPLOAD_STREAMING
+	// Streamed windows never have to fit the ring.
+	const size_t pool_bytes = RING_CAPACITY_SAMPLES * PCM_BYTES_PER_SAMPLE;
+	s_max_window_samples = window_ms_to_samples(MAX_WINDOW_MS);
+	s_ring_capacity = RING_CAPACITY_SAMPLES;
+#else
+	const size_t pool_bytes = CAPTURE_POOL_BYTES;
+	s_max_window_samples = max_window_samples(pool_bytes);
+	s_ring_capacity = s_max_window_samples * WINDOW_SLOTS + PREROLL_SAMPLES;
+	s_encoded_capacity = encoded_window_bytes(s_max_window_samples);
+#endif
+	size_t window_samples = window_ms_to_samples(s_settings.window_ms);
+	if (window_samples == 0 || window_samples > s_max_window_samples) {
+		window_samples = std::clamp<size_t>(window_samples, 1, s_max_window_samples);
+		ESP_LOGW(TAG, "%u ms windows do not fit the capture pool, using %u samples", static_cast<unsigned>(s_settings.window_ms), static_cast<unsigned>(window_samples));
+	}
+	s_window_samples = window_samples;
+	s_hop_samples = hop_ms_to_samples(s_settings.hop_ms, window_samples);
+
+	esp_err_t err = capture_pool_init(&s_pool, pool_bytes);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "No room for a %u byte capture pool", static_cast<unsigned>(pool_bytes));
+		return err;
+	}
+	int16_t* ring_storage = static_cast<int16_t*>(capture_pool_alloc(&s_pool, s_ring_capacity * PCM_BYTES_PER_SAMPLE));
+	if (s_encoded_capacity > 0) {
+		s_encoded = static_cast<uint8_t*>(capture_pool_alloc(&s_pool, s_encoded_capacity));
+	}
+	if (ring_storage == nullptr || (s_encoded_capacity > 0 && s_encoded == nullptr)) {
+		return ESP_ERR_NO_MEM;
+	}
+	audio_ring_init(&s_ring, ring_storage, s_ring_capacity);
+
+	ESP_LOGI(
+		TAG,
+		"Capture pool: %u bytes in %s RAM, ring=%u bytes (pre-roll %u bytes), encode buffer=%u bytes, DMA=%u bytes, decimator=%u bytes",
+		static_cast<unsigned>(s_pool.size),
+		s_pool.external ? "external" : "internal",
+		static_cast<unsigned>(s_ring_capacity * PCM_BYTES_PER_SAMPLE),
+		static_cast<unsigned>(PREROLL_SAMPLES * PCM_BYTES_PER_SAMPLE),
+		static_cast<unsigned>(s_encoded_capacity),
+		static_cast<unsigned>(I2S_DMA_DESC_NUM * I2S_DMA_FRAME_NUM * I2S_READ_BYTES_PER_SAMPLE),
+		static_cast<unsigned>(sizeof(s_decimator))
+	);
+	ESP_LOGI(
+		TAG,
+		"Windows: %u samples (%u ms) every %u samples, up to %u samples; heap left: internal %u bytes (largest block %u), external %u bytes",
+		static_cast<unsigned>(window_samples),
+		static_cast<unsigned>(s_settings.window_ms),
+		static_cast<unsigned>(s_hop_samples.load()),
+		static_cast<unsigned>(s_max_window_samples),
+		static_cast<unsigned>(heap_caps_get_free_size(MALLOC_CAP_INTERNAL)),
+		static_cast<unsigned>(heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL)),
+		static_cast<unsigned>(heap_caps_get_free_size(MALLOC_CAP_SPIRAM))
+	);
+	return ESP_OK;
+}
+
+esp_err_t microphone_uploader_start(const MicUploaderConfig* config) {
+	if (config == nullptr || config->endpoint == nullptr) {
+		ESP_LOGE(TAG, "Invalid microphone uploader configuration");
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	esp_err_t init_err = init_i2s_mic(config);
+	if (init_err != ESP_OK) {
+		ESP_LOGE(TAG, "I2S initialization failed");
+		return init_err;
+	}
+
+	if (DECIMATION_FACTOR > 1) {
+#if CONFIG_MIC_DECIMATION_FILTER_FAST
+		const DecimatorFilter filter = DecimatorFilter::Fast;
+#else
+		const DecimatorFilter filter = DecimatorFilter::Sharp;
+#endif
+		esp_err_t decimator_err = decimator_init(&s_decimator, DECIMATION_FACTOR, filter);
+		if (decimator_err != ESP_OK) {
+			ESP_LOGE(TAG, "Unsupported decimation factor %u", static_cast<unsigned>(DECIMATION_FACTOR));
+			return decimator_err;
+		}
+	}
+	ESP_LOGI(TAG, "Capture at %d Hz, upload at %d Hz", MIC_SAMPLE_RATE_HZ, UPLOAD_SAMPLE_RATE_HZ);
+	esp_err_t buffer_err = init_capture_buffers();
+	if (buffer_err != ESP_OK) {
+		return buffer_err;
+	}
+#if CONFIG_MIC_UPLOAD_CODEC_LOG_MEL
+	esp_err_t log_mel_err = log_mel_encoder_init(
+		&s_log_mel_encoder,
+		UPLOAD_SAMPLE_RATE_HZ,
+		CONFIG_MIC_MEL_FFT_SIZE,
+		CONFIG_MIC_MEL_HOP_SAMPLES,
+		CONFIG_MIC_MEL_BANDS,
+		CONFIG_MIC_MEL_FMIN_HZ,
+		CONFIG_MIC_MEL_FMAX_HZ
+	);
+	if (log_mel_err != ESP_OK) {
+		ESP_LOGE(TAG, "Unsupported log-mel settings for %d Hz", UPLOAD_SAMPLE_RATE_HZ);
+		return log_mel_err;
+	}
+	ESP_LOGI(
+		TAG,
+		"Uploading %d log-mel bands every %d samples (%u bytes per window)",
+		CONFIG_MIC_MEL_BANDS,
+		CONFIG_MIC_MEL_HOP_SAMPLES,
+		static_cast<unsigned>(log_mel_encoded_size(&s_log_mel_encoder, s_window_samples))
+	);
+#endif
+#if CONFIG_MIC_DC_BLOCK_ENABLE
+	dc_blocker_init(&s_dc_blocker, DC_BLOCK_SHIFT);
+#endif
+#if CONFIG_MIC_VAD_ENABLE
+	const uint32_t hangover_frames = CONFIG_MIC_VAD_HANGOVER_MS / VAD_FRAME_MS;
+	const size_t vad_frame_samples = UPLOAD_SAMPLE_RATE_HZ * VAD_FRAME_MS / 1000;
+	esp_err_t vad_err = ESP_ERR_NOT_SUPPORTED;
+#if CONFIG_MIC_VAD_MODE_BIRD_BANDS
+	vad_err = activity_detector_init_bird_bands(&s_activity, UPLOAD_SAMPLE_RATE_HZ, vad_frame_samples, CONFIG_MIC_VAD_THRESHOLD_DB, hangover_frames);
+	if (vad_err == ESP_OK) {
+		ESP_LOGI(TAG, "Activity detector: %u bird bins, %u rumble bins", static_cast<unsigned>(s_activity.bird_bins), static_cast<unsigned>(s_activity.bands.bin_count - s_activity.bird_bins));
+	} else {
+		ESP_LOGW(TAG, "No bird bands at %d Hz, detecting broadband energy", UPLOAD_SAMPLE_RATE_HZ);
+	}
+#endif
+	if (vad_err != ESP_OK) {
+		ESP_ERROR_CHECK(activity_detector_init(&s_activity, vad_frame_samples, CONFIG_MIC_VAD_THRESHOLD_DB, hangover_frames));
+	}
+#endif
+#if CONFIG_MIC_POWER_MANAGEMENT
+	if (power_manager_init() != ESP_OK) {
+		ESP_LOGW(TAG, "Power management unavailable, running at a fixed CPU frequency");
+	}
+#endif
+#if CONFIG_MIC_CLASSIFIER_ENABLE
+	if (bird_classifier_init(MODEL_PARTITION_LABEL, UPLOAD_SAMPLE_RATE_HZ) != ESP_OK) {
+		ESP_LOGW(TAG, "Bird classifier unavailable, uploading every active window");
+	}
+#endif
+
+	gpio_reset_pin(config->blink_gpio);
+	gpio_set_direction(config->blink_gpio, GPIO_MODE_OUTPUT);
+
+	BaseType_t task_ok = pdPASS;
+	retry_backoff_init(&s_backoff);
+	ESP_ERROR_CHECK_WITHOUT_ABORT(esp_read_mac(s_device_mac, ESP_MAC_WIFI_STA));
+	s_stream_id = esp_random();
+	esp_err_t http_err = http_uploader_init(&s_http_uploader, config->endpoint);
+	if (http_err != ESP_OK) {
+		return http_err;
+	}
+	set_upload_headers(&s_http_uploader);
+	ESP_LOGI(TAG, "Upload encoding %s", UPLOAD_ENCODING);
+
+#if CONFIG_MIC_SPOOL_ENABLE
+	// Without the partition the uploader still runs; failed windows are dropped as before.
+	if (clip_queue_init(&s_clip_queue, SPOOL_PARTITION_LABEL) == ESP_OK && http_uploader_init(&s_drain_uploader, config->endpoint) == ESP_OK) {
+		set_upload_headers(&s_drain_uploader);
+		task_ok = xTaskCreate(
+			microphone_drain_task,
+			"microphone_drain_task",
+			static_cast<uint32_t>(config->drain_task_stack_size),
+			nullptr,
+			static_cast<UBaseType_t>(config->drain_task_priority),
+			&s_drain_task
 		);
-		ESP_LOGI(TAG, "Uploading audio payload");
-		ESP_ERROR_CHECK_WITHOUT_ABORT(send_binary_post(config->endpoint, reinterpret_cast<const uint8_t*>(audio_buffer.data()), total_bytes_read));
+		s_spool_ready = task_ok == pdPASS;
+	}
+	if (!s_spool_ready) {
+		ESP_LOGW(TAG, "Flash spool unavailable, windows that fail to upload will be dropped");
+	}
+#endif
 
+	s_window_queue = xQueueCreate(WINDOW_QUEUE_DEPTH, sizeof(CapturedWindow));
+	if (s_window_queue == nullptr) {
+		ESP_LOGE(TAG, "Failed to create window queue");
+		return ESP_ERR_NO_MEM;
+	}
+
+#if CONFIG_MIC_TRIGGER_ENABLE
+	static const SoundTriggerConfig trigger_config = {
+		.threshold = CONFIG_MIC_TRIGGER_THRESHOLD,
+		.hysteresis = CONFIG_MIC_TRIGGER_HYSTERESIS,
+		.hold_ms = CONFIG_MIC_TRIGGER_HOLD_MS,
+		.task_stack_size = 4096,
+		.task_priority = config->capture_task_priority - 1,
+	};
+	esp_err_t trigger_err = sound_trigger_start(&trigger_config);
+	if (trigger_err != ESP_OK) {
+		ESP_LOGE(TAG, "Sound trigger initialization failed");
+		return trigger_err;
+	}
+#endif
+
+	task_ok = xTaskCreate(
+		microphone_upload_task,
+		"microphone_upload_task",
+		static_cast<uint32_t>(config->upload_task_stack_size),
+		const_cast<MicUploaderConfig*>(config),
+		static_cast<UBaseType_t>(config->upload_task_priority),
+		&s_upload_task
+	);
+	if (task_ok != pdPASS) {
+		ESP_LOGE(TAG, "Failed to create microphone upload task");
+		return ESP_FAIL;
+	}
+
+	task_ok = xTaskCreate(
+		microphone_capture_task,
+		"microphone_capture_task",
+		static_cast<uint32_t>(config->capture_task_stack_size),
+		const_cast<MicUploaderConfig*>(config),
+		static_cast<UBaseType_t>(config->capture_task_priority),
+		nullptr
+	);
+	if (task_ok != pdPASS) {
+		ESP_LOGE(TAG, "Failed to create microphone capture task");
+		return ESP_FAIL;
+	}
+
+#if CONFIG_MIC_TRIGGER_ENABLE
+	// Capture starts on the first trigger; until then the radio can sleep.
+	app_network_set_power_save(true);
+	if (PREROLL_SAMPLES == 0) {
+		return ESP_OK;
+	}
+#endif
+	return start_i2s_capture();
+}
+
+void microphone_uploader_get_stats(MicUploaderStats* stats) {
+	if (stats == nullptr) {
+		return;
+	}
+	stats->windows_captured = s_windows_captured;
+	stats->windows_uploaded = s_windows_uploaded;
+	stats->windows_suppressed = s_windows_suppressed;
+	portENTER_CRITICAL(&s_hourly_lock);
+	std::copy(std::begin(s_hourly), std::end(s_hourly), stats->hourly);
+	portEXIT_CRITICAL(&s_hourly_lock);
+	stats->samples_dropped = s_samples_dropped;
+	stats->dma_overruns = s_dma_overruns;
+	stats->http = s_http_uploader.stats;
+	bird_classifier_get_stats(&stats->classifier);
+	if (s_spool_ready) {
+		clip_queue_get_stats(&s_clip_queue, &stats->spool);
+	} else {
+		stats->spool = {};
 	}
 }
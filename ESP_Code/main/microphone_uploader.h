@@ -1,6 +1,12 @@
 #pragma once
 
+#include <stdint.h>
+
+#include "bird_classifier.h"
 #include "driver/gpio.h"
+#include "clip_queue.h"
+#include "esp_err.h"
+#include "network_rest.h"
 
 struct MicUploaderConfig {
 	const char* endpoint;
@@ -9,8 +15,38 @@ struct MicUploaderConfig {
 	gpio_num_t i2s_dout_gpio;
 	gpio_num_t i2s_bclk_gpio;
 	gpio_num_t blink_gpio;
-	int task_stack_size;
-	int task_priority;
+	int capture_task_stack_size;
+	int capture_task_priority;
+	int upload_task_stack_size;
+	int upload_task_priority;
+	int drain_task_stack_size;
+	int drain_task_priority;
+};
+
+// Upload decisions made in one hour. hour counts from the Unix epoch, or from boot while the clock
+// is not yet set.
+struct WindowHourStats {
+	uint32_t hour;
+	uint32_t windows_uploaded;
+	uint32_t windows_suppressed;
+};
+
+static constexpr size_t MIC_STATS_HOURS = 24;
+
+struct MicUploaderStats {
+	uint32_t windows_captured;
+	uint32_t windows_uploaded;
+	uint32_t windows_suppressed;
+	uint32_t samples_dropped;
+	uint32_t dma_overruns;
+	HttpUploaderStats http;
+	ClipQueueStats spool;
+	BirdClassifierStats classifier;
+	// The last day, in slot hour % MIC_STATS_HOURS; a slot whose hour is older is stale.
+	WindowHourStats hourly[MIC_STATS_HOURS];
 };
 
-void microphone_uploader_task(void* pv_parameters);
+// Starts the capture task (drains I2S into the sample ring), the upload task (ships completed windows)
+// and, with the flash spool enabled, the drain task (replays windows that could not be uploaded).
+esp_err_t microphone_uploader_start(const MicUploaderConfig* config);
+void microphone_uploader_get_stats(MicUploaderStats* stats);
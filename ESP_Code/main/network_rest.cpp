@@ -1,12 +1,20 @@
 #include "network_rest.h"
 
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+
 #include "esp_event.h"
 #include "esp_http_client.h"
 #include "esp_log.h"
 #include "esp_netif.h"
+#include "esp_netif_sntp.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
 #include "nvs_flash.h"
 #include "protocol_examples_common.h"
+#include "sdkconfig.h"
 
 static const char* TAG = "network_rest";
 
@@ -35,6 +43,14 @@ esp_err_t app_network_init_and_connect() {
 		return err;
 	}
 
+	// Clip headers carry wall-clock capture times. Sync runs in the background; until it
+	// completes, clips are sent with a zero timestamp.
+	esp_sntp_config_t sntp_config = ESP_NETIF_SNTP_DEFAULT_CONFIG(CONFIG_MIC_SNTP_SERVER);
+	err = esp_netif_sntp_init(&sntp_config);
+	if (err != ESP_OK) {
+		ESP_LOGW(TAG, "SNTP init failed: %s", esp_err_to_name(err));
+	}
+
 	return ESP_OK;
 }
 
@@ -53,35 +69,304 @@ void app_log_connected_ap_info() {
 	ESP_LOGI(TAG, "RSSI: %d", ap_info.rssi);
 }
 
-esp_err_t send_binary_post(const char* url, const uint8_t* data, size_t data_len) {
-	if (url == nullptr || data == nullptr || data_len == 0) {
-		ESP_LOGE(TAG, "Upload args are invalid");
+bool app_network_is_connected() {
+	wifi_ap_record_t ap_info = {};
+	return esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK;
+}
+
+void app_network_set_power_save(bool low_power) {
+	// Maximum modem sleep keeps the association but only wakes for DTIM beacons; it is used while
+	// there is nothing to upload.
+	esp_err_t err = esp_wifi_set_ps(low_power ? WIFI_PS_MAX_MODEM : WIFI_PS_MIN_MODEM);
+	if (err != ESP_OK) {
+		ESP_LOGW(TAG, "esp_wifi_set_ps failed: %s", esp_err_to_name(err));
+	}
+}
+
+static esp_err_t http_write_all(esp_http_client_handle_t client, const char* data, size_t data_len) {
+	size_t written = 0;
+	while (written < data_len) {
+		const int result = esp_http_client_write(client, data + written, static_cast<int>(data_len - written));
+		if (result <= 0) {
+			return ESP_ERR_HTTP_WRITE_DATA;
+		}
+		written += static_cast<size_t>(result);
+	}
+	return ESP_OK;
+}
+
+static bool parse_header_number(const char* value, unsigned long* number) {
+	char* end = nullptr;
+	*number = strtoul(value, &end, 10);
+	return end != value && *end == '\0';
+}
+
+static esp_err_t http_uploader_event_handler(esp_http_client_event_t* event) {
+	HttpUploader* uploader = static_cast<HttpUploader*>(event->user_data);
+	switch (event->event_id) {
+	case HTTP_EVENT_ON_CONNECTED:
+		++uploader->stats.connections_opened;
+		break;
+	case HTTP_EVENT_ON_HEADER:
+		if (strcasecmp(event->header_key, "Connection") == 0 && strcasecmp(event->header_value, "close") == 0) {
+			uploader->server_closing = true;
+		}
+		// Only the delay-seconds form is understood; an HTTP-date falls back to plain backoff.
+		if (strcasecmp(event->header_key, "Retry-After") == 0) {
+			unsigned long seconds = 0;
+			if (parse_header_number(event->header_value, &seconds)) {
+				uploader->retry_after_ms = static_cast<uint32_t>(std::min<unsigned long>(seconds, UINT32_MAX / 1000) * 1000);
+			}
+		}
+		if (strcasecmp(event->header_key, "X-Window-Ms") == 0) {
+			unsigned long window_ms = 0;
+			if (parse_header_number(event->header_value, &window_ms)) {
+				uploader->window_ms = static_cast<uint32_t>(std::min<unsigned long>(window_ms, UINT32_MAX));
+			}
+		}
+		if (strcasecmp(event->header_key, "X-Hop-Ms") == 0) {
+			unsigned long hop_ms = 0;
+			uploader->has_hop_ms = parse_header_number(event->header_value, &hop_ms);
+			uploader->hop_ms = static_cast<uint32_t>(std::min<unsigned long>(hop_ms, UINT32_MAX));
+		}
+		break;
+	case HTTP_EVENT_DISCONNECTED:
+		uploader->connection_open = false;
+		break;
+	default:
+		break;
+	}
+	return ESP_OK;
+}
+
+static void http_uploader_close(HttpUploader* uploader) {
+	esp_http_client_close(uploader->client);
+	uploader->connection_open = false;
+}
+
+// Starts a request on the shared connection. An idle socket is only reused while it is younger
+// than the configured limit; older ones are closed first rather than risk a silent server timeout.
+static esp_err_t http_uploader_request_begin(HttpUploader* uploader, int content_length, bool* reused) {
+	const int64_t idle_us = esp_timer_get_time() - uploader->last_response_us;
+	if (uploader->connection_open && idle_us > static_cast<int64_t>(CONFIG_MIC_HTTP_REUSE_IDLE_MS) * 1000) {
+		http_uploader_close(uploader);
+	}
+
+	*reused = uploader->connection_open;
+	uploader->server_closing = false;
+	uploader->last_status = 0;
+	uploader->retry_after_ms = 0;
+	uploader->window_ms = 0;
+	uploader->hop_ms = 0;
+	uploader->has_hop_ms = false;
+
+	esp_err_t err = esp_http_client_open(uploader->client, content_length);
+	if (err != ESP_OK) {
+		http_uploader_close(uploader);
+		return err;
+	}
+
+	uploader->connection_open = true;
+	++uploader->stats.requests;
+	if (*reused) {
+		++uploader->stats.connections_reused;
+	}
+	return ESP_OK;
+}
+
+// Reads the response and drains its body so the socket can carry the next request.
+static esp_err_t http_uploader_request_end(HttpUploader* uploader) {
+	esp_http_client_handle_t client = uploader->client;
+	const int64_t content_length = esp_http_client_fetch_headers(client);
+	if (content_length < 0) {
+		http_uploader_close(uploader);
+		return ESP_ERR_HTTP_FETCH_HEADER;
+	}
+
+	const int status_code = esp_http_client_get_status_code(client);
+	esp_http_client_flush_response(client, nullptr);
+	if (status_code <= 0) {
+		http_uploader_close(uploader);
+		return ESP_ERR_HTTP_CONNECTION_CLOSED;
+	}
+
+	if (uploader->server_closing || !esp_http_client_is_complete_data_received(client)) {
+		http_uploader_close(uploader);
+	}
+	uploader->last_response_us = esp_timer_get_time();
+	uploader->last_status = status_code;
+
+	ESP_LOGI(
+		TAG,
+		"Upload status=%d, requests=%u, reused=%u, opened=%u, reconnects=%u",
+		status_code,
+		static_cast<unsigned>(uploader->stats.requests),
+		static_cast<unsigned>(uploader->stats.connections_reused),
+		static_cast<unsigned>(uploader->stats.connections_opened),
+		static_cast<unsigned>(uploader->stats.reconnects)
+	);
+	if (status_code < 200 || status_code >= 300) {
+		ESP_LOGW(TAG, "Upload not accepted, status=%d retry_after=%u ms", status_code, static_cast<unsigned>(uploader->retry_after_ms));
+		return ESP_ERR_INVALID_RESPONSE;
+	}
+	return ESP_OK;
+}
+
+esp_err_t http_uploader_init(HttpUploader* uploader, const char* url) {
+	if (uploader == nullptr || url == nullptr) {
+		ESP_LOGE(TAG, "Uploader args are invalid");
 		return ESP_ERR_INVALID_ARG;
 	}
 
+	*uploader = {};
+
 	esp_http_client_config_t config = {};
 	config.url = url;
-	config.timeout_ms = 10000;
+	config.timeout_ms = CONFIG_MIC_HTTP_TIMEOUT_MS;
+	config.keep_alive_enable = true;
+	config.event_handler = http_uploader_event_handler;
+	config.user_data = uploader;
 
-	esp_http_client_handle_t client = esp_http_client_init(&config);
-	if (client == nullptr) {
+	uploader->client = esp_http_client_init(&config);
+	if (uploader->client == nullptr) {
 		ESP_LOGE(TAG, "Failed to initialize HTTP client");
 		return ESP_FAIL;
 	}
 
-	ESP_ERROR_CHECK_WITHOUT_ABORT(esp_http_client_set_method(client, HTTP_METHOD_POST));
-	ESP_ERROR_CHECK_WITHOUT_ABORT(esp_http_client_set_header(client, "Content-Type", "application/octet-stream"));
-	ESP_ERROR_CHECK_WITHOUT_ABORT(esp_http_client_set_post_field(client, reinterpret_cast<const char*>(data), data_len));
+	ESP_ERROR_CHECK_WITHOUT_ABORT(esp_http_client_set_method(uploader->client, HTTP_METHOD_POST));
+	ESP_ERROR_CHECK_WITHOUT_ABORT(esp_http_client_set_header(uploader->client, "Content-Type", "application/octet-stream"));
+	return ESP_OK;
+}
+
+void http_uploader_deinit(HttpUploader* uploader) {
+	if (uploader == nullptr || uploader->client == nullptr) {
+		return;
+	}
+	esp_http_client_cleanup(uploader->client);
+	uploader->client = nullptr;
+	uploader->connection_open = false;
+}
+
+esp_err_t http_uploader_set_header(HttpUploader* uploader, const char* key, const char* value) {
+	if (uploader == nullptr || uploader->client == nullptr || key == nullptr || value == nullptr) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	return esp_http_client_set_header(uploader->client, key, value);
+}
+
+esp_err_t http_uploader_post(HttpUploader* uploader, const HttpBodySegment* segments, size_t segment_count) {
+	size_t data_len = 0;
+	for (size_t index = 0; segments != nullptr && index < segment_count; ++index) {
+		data_len += segments[index].length;
+	}
+	if (uploader == nullptr || uploader->client == nullptr || data_len == 0) {
+		ESP_LOGE(TAG, "Upload args are invalid");
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	// A failure on a reused socket usually means the server closed it while idle; the whole body
+	// is still in hand, so retry once on a fresh connection before reporting the error.
+	esp_err_t err = ESP_FAIL;
+	for (int attempt = 0; attempt < 2; ++attempt) {
+		bool reused = false;
+		err = http_uploader_request_begin(uploader, static_cast<int>(data_len), &reused);
+		if (err == ESP_OK) {
+			for (size_t index = 0; index < segment_count && err == ESP_OK; ++index) {
+				err = http_write_all(uploader->client, reinterpret_cast<const char*>(segments[index].data), segments[index].length);
+			}
+			if (err == ESP_OK) {
+				err = http_uploader_request_end(uploader);
+			} else {
+				http_uploader_close(uploader);
+			}
+		}
+
+		if (err == ESP_OK || err == ESP_ERR_INVALID_RESPONSE || !reused) {
+			break;
+		}
+		++uploader->stats.reconnects;
+		ESP_LOGW(TAG, "Reused connection failed (%s), reconnecting", esp_err_to_name(err));
+	}
+
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "HTTP upload failed: %s", esp_err_to_name(err));
+	}
+	return err;
+}
+
+esp_err_t http_uploader_stream_open(HttpUploader* uploader) {
+	if (uploader == nullptr || uploader->client == nullptr) {
+		ESP_LOGE(TAG, "Stream args are invalid");
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	// A negative write length makes the client send Transfer-Encoding: chunked; chunk framing is ours.
+	bool reused = false;
+	esp_err_t err = http_uploader_request_begin(uploader, -1, &reused);
+	if (err != ESP_OK && reused) {
+		++uploader->stats.reconnects;
+		err = http_uploader_request_begin(uploader, -1, &reused);
+	}
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "HTTP stream open failed: %s", esp_err_to_name(err));
+		return err;
+	}
+
+	uploader->stream_bytes_sent = 0;
+	return ESP_OK;
+}
+
+esp_err_t http_uploader_stream_write(HttpUploader* uploader, const uint8_t* data, size_t data_len) {
+	if (uploader == nullptr || uploader->client == nullptr || data == nullptr) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	if (data_len == 0) {
+		return ESP_OK;
+	}
+
+	char chunk_header[16];
+	const int header_len = snprintf(chunk_header, sizeof(chunk_header), "%x\r\n", static_cast<unsigned>(data_len));
 
-	esp_err_t err = esp_http_client_perform(client);
+	esp_err_t err = http_write_all(uploader->client, chunk_header, static_cast<size_t>(header_len));
+	if (err == ESP_OK) {
+		err = http_write_all(uploader->client, reinterpret_cast<const char*>(data), data_len);
+	}
 	if (err == ESP_OK) {
-		int status_code = esp_http_client_get_status_code(client);
-		int64_t content_length = esp_http_client_get_content_length(client);
-		ESP_LOGI(TAG, "Upload status=%d, content_length=%lld", status_code, content_length);
+		err = http_write_all(uploader->client, "\r\n", 2);
+	}
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "HTTP stream write failed after %u bytes", static_cast<unsigned>(uploader->stream_bytes_sent));
+		return err;
+	}
+
+	uploader->stream_bytes_sent += data_len;
+	return ESP_OK;
+}
+
+esp_err_t http_uploader_stream_finish(HttpUploader* uploader) {
+	if (uploader == nullptr || uploader->client == nullptr) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	esp_err_t err = http_write_all(uploader->client, "0\r\n\r\n", 5);
+	if (err == ESP_OK) {
+		err = http_uploader_request_end(uploader);
 	} else {
-		ESP_LOGE(TAG, "HTTP upload failed: %s", esp_err_to_name(err));
+		http_uploader_close(uploader);
 	}
 
-	esp_http_client_cleanup(client);
+	if (err == ESP_OK) {
+		ESP_LOGI(TAG, "Stream upload finished, bytes_sent=%u", static_cast<unsigned>(uploader->stream_bytes_sent));
+	} else {
+		ESP_LOGE(TAG, "HTTP stream finish failed: %s", esp_err_to_name(err));
+	}
 	return err;
 }
+
+void http_uploader_stream_abort(HttpUploader* uploader) {
+	if (uploader == nullptr || uploader->client == nullptr) {
+		return;
+	}
+	// The request body is half written, so the socket cannot be reused.
+	http_uploader_close(uploader);
+}
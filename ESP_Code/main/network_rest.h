@@ -3,7 +3,54 @@
 #include <stddef.h>
 #include <stdint.h>
 #include "esp_err.h"
+#include "esp_http_client.h"
 
 esp_err_t app_network_init_and_connect();
 void app_log_connected_ap_info();
-esp_err_t send_binary_post(const char* url, const uint8_t* data, size_t data_len);
+bool app_network_is_connected();
+void app_network_set_power_save(bool low_power);
+
+struct HttpUploaderStats {
+	uint32_t requests;
+	uint32_t connections_opened;
+	uint32_t connections_reused;
+	uint32_t reconnects;
+};
+
+// Long-lived upload connection: one client handle and, while the server keeps it open, one socket
+// shared by every upload. A reused connection the server has dropped is reopened transparently.
+struct HttpUploader {
+	esp_http_client_handle_t client;
+	bool connection_open;
+	bool server_closing;
+	int64_t last_response_us;
+	// Status and Retry-After of the last response, 0 if the request got no response.
+	int last_status;
+	uint32_t retry_after_ms;
+	// X-Window-Ms of the last response: the window length the server wants, 0 if it did not say.
+	uint32_t window_ms;
+	// X-Hop-Ms of the last response, where 0 asks for back-to-back windows; valid if has_hop_ms.
+	uint32_t hop_ms;
+	bool has_hop_ms;
+	size_t stream_bytes_sent;
+	HttpUploaderStats stats;
+};
+
+esp_err_t http_uploader_init(HttpUploader* uploader, const char* url);
+void http_uploader_deinit(HttpUploader* uploader);
+// Request header sent with every subsequent upload on this client.
+esp_err_t http_uploader_set_header(HttpUploader* uploader, const char* key, const char* value);
+// Posts the concatenation of the segments with a Content-Length body, so callers can send data that
+// wraps around a ring buffer without first copying it into one block.
+struct HttpBodySegment {
+	const uint8_t* data;
+	size_t length;
+};
+
+esp_err_t http_uploader_post(HttpUploader* uploader, const HttpBodySegment* segments, size_t segment_count);
+
+// Chunked (Transfer-Encoding: chunked) POST whose body is written piecewise while it is produced.
+esp_err_t http_uploader_stream_open(HttpUploader* uploader);
+esp_err_t http_uploader_stream_write(HttpUploader* uploader, const uint8_t* data, size_t data_len);
+esp_err_t http_uploader_stream_finish(HttpUploader* uploader);
+void http_uploader_stream_abort(HttpUploader* uploader);
@@ -0,0 +1,65 @@
+#include "power_manager.h"
+
+#include <stdio.h>
+
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "sdkconfig.h"
+
+#if CONFIG_MIC_POWER_MANAGEMENT
+static const char* TAG = "power_manager";
+static esp_pm_lock_handle_t s_boost_lock = nullptr;
+
+esp_err_t power_manager_init() {
+	esp_pm_config_t pm_config = {};
+	pm_config.max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+	pm_config.min_freq_mhz = CONFIG_XTAL_FREQ;
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+	pm_config.light_sleep_enable = true;
+#endif
+	esp_err_t err = esp_pm_configure(&pm_config);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "esp_pm_configure failed: %s", esp_err_to_name(err));
+		return err;
+	}
+	err = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "mic_upload", &s_boost_lock);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "esp_pm_lock_create failed: %s", esp_err_to_name(err));
+		return err;
+	}
+	ESP_LOGI(
+		TAG,
+		"CPU %d-%d MHz, light sleep %s",
+		pm_config.min_freq_mhz,
+		pm_config.max_freq_mhz,
+		pm_config.light_sleep_enable ? "allowed" : "off"
+	);
+	return ESP_OK;
+}
+
+void power_manager_boost_begin() {
+	if (s_boost_lock != nullptr) {
+		esp_pm_lock_acquire(s_boost_lock);
+	}
+}
+
+void power_manager_boost_end() {
+	if (s_boost_lock != nullptr) {
+		esp_pm_lock_release(s_boost_lock);
+	}
+}
+
+void power_manager_log_stats() {
+	ESP_ERROR_CHECK_WITHOUT_ABORT(esp_pm_dump_locks(stdout));
+}
+#else
+esp_err_t power_manager_init() {
+	return ESP_ERR_NOT_SUPPORTED;
+}
+
+void power_manager_boost_begin() {}
+
+void power_manager_boost_end() {}
+
+void power_manager_log_stats() {}
+#endif
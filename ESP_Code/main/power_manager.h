@@ -0,0 +1,19 @@
+#pragma once
+
+#include "esp_err.h"
+
+// Dynamic frequency scaling for the capture pipeline. Once configured, the CPU drops to the
+// crystal frequency whenever no driver holds a lock. The I2S and ADC continuous drivers hold an
+// APB_FREQ_MAX lock of their own while their channel is enabled, which keeps the CPU at the APB
+// frequency (80 MHz on the ESP32-C3) and rules out light sleep for as long as DMA runs. Encoding
+// and uploading take a boost to the maximum CPU frequency on top. Light sleep is allowed when
+// FreeRTOS tickless idle is enabled, and only happens while no DMA lock is held.
+esp_err_t power_manager_init();
+
+// Holds the CPU at its maximum frequency between begin and end. Nests and may be taken by several
+// tasks at once.
+void power_manager_boost_begin();
+void power_manager_boost_end();
+
+// Prints every lock and, with CONFIG_PM_PROFILING, the time spent in each power mode since boot.
+void power_manager_log_stats();
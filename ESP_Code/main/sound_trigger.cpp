@@ -0,0 +1,165 @@
+#include "sound_trigger.h"
+
+#include <algorithm>
+#include <array>
+
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_adc/adc_continuous.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+// Sound level sensor output is wired to GPIO2, which is ADC1 channel 2 on the ESP32-C3.
+static constexpr adc_channel_t SOUND_LEVEL_ADC_CHANNEL = ADC_CHANNEL_2;
+static constexpr uint32_t ADC_SAMPLE_RATE_HZ = 20000;
+static constexpr uint32_t ADC_FRAME_BYTES = 256 * SOC_ADC_DIGI_RESULT_BYTES;
+static constexpr EventBits_t TRIGGER_ACTIVE_BIT = BIT0;
+static const char* TAG = "sound_trigger";
+
+static adc_continuous_handle_t s_adc_handle = nullptr;
+static EventGroupHandle_t s_trigger_events = nullptr;
+static TaskHandle_t s_trigger_task = nullptr;
+static volatile uint32_t s_level = 0;
+
+static bool IRAM_ATTR on_adc_frame(adc_continuous_handle_t handle, const adc_continuous_evt_data_t* event, void* user_data) {
+	BaseType_t need_yield = pdFALSE;
+	vTaskNotifyGiveFromISR(s_trigger_task, &need_yield);
+	return need_yield == pdTRUE;
+}
+
+static void sound_trigger_task(void* pv_parameters) {
+	const SoundTriggerConfig* config = static_cast<const SoundTriggerConfig*>(pv_parameters);
+	const uint32_t release_level = config->threshold > config->hysteresis ? config->threshold - config->hysteresis : 0;
+	const int64_t hold_us = static_cast<int64_t>(config->hold_ms) * 1000;
+
+	std::array<uint8_t, ADC_FRAME_BYTES> frame = {};
+	bool active = false;
+	int64_t last_loud_us = 0;
+
+	while (true) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+		uint32_t bytes_read = 0;
+		while (adc_continuous_read(s_adc_handle, frame.data(), frame.size(), &bytes_read, 0) == ESP_OK) {
+			uint32_t min_level = UINT32_MAX;
+			uint32_t max_level = 0;
+			for (uint32_t offset = 0; offset + SOC_ADC_DIGI_RESULT_BYTES <= bytes_read; offset += SOC_ADC_DIGI_RESULT_BYTES) {
+				const adc_digi_output_data_t* result = reinterpret_cast<const adc_digi_output_data_t*>(frame.data() + offset);
+				if (result->type2.channel != SOUND_LEVEL_ADC_CHANNEL) {
+					continue;
+				}
+				min_level = std::min<uint32_t>(min_level, result->type2.data);
+				max_level = std::max<uint32_t>(max_level, result->type2.data);
+			}
+			if (max_level < min_level) {
+				continue;
+			}
+
+			const uint32_t level = max_level - min_level;
+			const int64_t now_us = esp_timer_get_time();
+			s_level = level;
+
+			if (level >= config->threshold || (active && level > release_level)) {
+				last_loud_us = now_us;
+			}
+
+			if (!active && level >= config->threshold) {
+				active = true;
+				xEventGroupSetBits(s_trigger_events, TRIGGER_ACTIVE_BIT);
+				ESP_LOGI(TAG, "Triggered at level %u", static_cast<unsigned>(level));
+			} else if (active && now_us - last_loud_us > hold_us) {
+				active = false;
+				xEventGroupClearBits(s_trigger_events, TRIGGER_ACTIVE_BIT);
+				ESP_LOGI(TAG, "Released at level %u", static_cast<unsigned>(level));
+			}
+		}
+	}
+}
+
+esp_err_t sound_trigger_start(const SoundTriggerConfig* config) {
+	if (config == nullptr) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	s_trigger_events = xEventGroupCreate();
+	if (s_trigger_events == nullptr) {
+		ESP_LOGE(TAG, "Failed to create trigger event group");
+		return ESP_ERR_NO_MEM;
+	}
+
+	adc_continuous_handle_cfg_t handle_config = {};
+	handle_config.max_store_buf_size = ADC_FRAME_BYTES * 4;
+	handle_config.conv_frame_size = ADC_FRAME_BYTES;
+	esp_err_t err = adc_continuous_new_handle(&handle_config, &s_adc_handle);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "adc_continuous_new_handle failed: %s", esp_err_to_name(err));
+		return err;
+	}
+
+	adc_digi_pattern_config_t pattern = {};
+	pattern.atten = ADC_ATTEN_DB_12;
+	pattern.channel = SOUND_LEVEL_ADC_CHANNEL;
+	pattern.unit = ADC_UNIT_1;
+	pattern.bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+
+	adc_continuous_config_t adc_config = {};
+	adc_config.pattern_num = 1;
+	adc_config.adc_pattern = &pattern;
+	adc_config.sample_freq_hz = ADC_SAMPLE_RATE_HZ;
+	adc_config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+	adc_config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE2;
+	err = adc_continuous_config(s_adc_handle, &adc_config);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "adc_continuous_config failed: %s", esp_err_to_name(err));
+		return err;
+	}
+
+	BaseType_t task_ok = xTaskCreate(
+		sound_trigger_task,
+		"sound_trigger_task",
+		static_cast<uint32_t>(config->task_stack_size),
+		const_cast<SoundTriggerConfig*>(config),
+		static_cast<UBaseType_t>(config->task_priority),
+		&s_trigger_task
+	);
+	if (task_ok != pdPASS) {
+		ESP_LOGE(TAG, "Failed to create sound trigger task");
+		return ESP_FAIL;
+	}
+
+	adc_continuous_evt_cbs_t callbacks = {};
+	callbacks.on_conv_done = on_adc_frame;
+	err = adc_continuous_register_event_callbacks(s_adc_handle, &callbacks, nullptr);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "adc_continuous_register_event_callbacks failed: %s", esp_err_to_name(err));
+		return err;
+	}
+
+	err = adc_continuous_start(s_adc_handle);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "adc_continuous_start failed: %s", esp_err_to_name(err));
+		return err;
+	}
+
+	ESP_LOGI(
+		TAG,
+		"Sound trigger armed: threshold=%u hysteresis=%u hold=%u ms",
+		static_cast<unsigned>(config->threshold),
+		static_cast<unsigned>(config->hysteresis),
+		static_cast<unsigned>(config->hold_ms)
+	);
+	return ESP_OK;
+}
+
+bool sound_trigger_wait(TickType_t timeout) {
+	const EventBits_t bits = xEventGroupWaitBits(s_trigger_events, TRIGGER_ACTIVE_BIT, pdFALSE, pdTRUE, timeout);
+	return (bits & TRIGGER_ACTIVE_BIT) != 0;
+}
+
+bool sound_trigger_active() {
+	return (xEventGroupGetBits(s_trigger_events) & TRIGGER_ACTIVE_BIT) != 0;
+}
+
+uint32_t sound_trigger_level() {
+	return s_level;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+struct SoundTriggerConfig {
+	uint32_t threshold;
+	uint32_t hysteresis;
+	uint32_t hold_ms;
+	int task_stack_size;
+	int task_priority;
+};
+
+// Samples the analog sound-level sensor through the ADC continuous (DMA) driver and keeps a
+// fired/released state: fires when the per-frame peak-to-peak level reaches threshold, releases
+// once it has stayed below threshold - hysteresis for hold_ms.
+esp_err_t sound_trigger_start(const SoundTriggerConfig* config);
+bool sound_trigger_wait(TickType_t timeout);
+bool sound_trigger_active();
+uint32_t sound_trigger_level();
@@ -0,0 +1,85 @@
+#include "upload_retry.h"
+
+#include <algorithm>
+
+#include "esp_http_client.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+
+// Upper bound on a server-supplied Retry-After, so one bad header cannot park the node for days.
+static constexpr uint32_t MAX_RETRY_AFTER_MS = 60 * 60 * 1000;
+
+UploadFailure upload_failure_classify(esp_err_t err, int http_status) {
+	if (http_status == 429) {
+		return UploadFailure::RateLimited;
+	}
+	if (http_status >= 500) {
+		return UploadFailure::ServerError;
+	}
+	if (http_status >= 300) {
+		return UploadFailure::Rejected;
+	}
+	if (err == ESP_OK) {
+		return UploadFailure::None;
+	}
+	if (err == ESP_ERR_HTTP_CONNECT) {
+		return UploadFailure::Connect;
+	}
+	return UploadFailure::Timeout;
+}
+
+const char* upload_failure_name(UploadFailure failure) {
+	switch (failure) {
+		case UploadFailure::None: return "none";
+		case UploadFailure::Connect: return "connect";
+		case UploadFailure::Timeout: return "timeout";
+		case UploadFailure::RateLimited: return "rate limited";
+		case UploadFailure::ServerError: return "server error";
+		case UploadFailure::Rejected: return "rejected";
+		case UploadFailure::Deferred: return "deferred";
+	}
+	return "unknown";
+}
+
+bool upload_failure_retryable(UploadFailure failure) {
+	return failure != UploadFailure::None && failure != UploadFailure::Rejected;
+}
+
+void retry_backoff_init(RetryBackoff* backoff) {
+	portMUX_INITIALIZE(&backoff->lock);
+	backoff->not_before_us = 0;
+	backoff->consecutive_failures = 0;
+}
+
+void retry_backoff_success(RetryBackoff* backoff) {
+	portENTER_CRITICAL(&backoff->lock);
+	backoff->consecutive_failures = 0;
+	portEXIT_CRITICAL(&backoff->lock);
+}
+
+uint32_t retry_backoff_failure(RetryBackoff* backoff, const RetryPolicy* policy, uint32_t retry_after_ms) {
+	portENTER_CRITICAL(&backoff->lock);
+	const uint32_t failures = ++backoff->consecutive_failures;
+	portEXIT_CRITICAL(&backoff->lock);
+
+	// Half the capped exponential step is fixed and half random, so nodes that failed together
+	// spread out without any of them retrying immediately.
+	const uint32_t shift = std::min<uint32_t>(failures - 1, 16);
+	const uint32_t step_ms = static_cast<uint32_t>(std::min<uint64_t>(static_cast<uint64_t>(policy->base_delay_ms) << shift, policy->max_delay_ms));
+	uint32_t delay_ms = step_ms / 2 + esp_random() % (step_ms / 2 + 1);
+	delay_ms = std::max(delay_ms, std::min(retry_after_ms, MAX_RETRY_AFTER_MS));
+
+	const int64_t not_before_us = esp_timer_get_time() + static_cast<int64_t>(delay_ms) * 1000;
+	portENTER_CRITICAL(&backoff->lock);
+	backoff->not_before_us = std::max(backoff->not_before_us, not_before_us);
+	portEXIT_CRITICAL(&backoff->lock);
+	return delay_ms;
+}
+
+uint32_t retry_backoff_remaining_ms(RetryBackoff* backoff) {
+	portENTER_CRITICAL(&backoff->lock);
+	const int64_t not_before_us = backoff->not_before_us;
+	portEXIT_CRITICAL(&backoff->lock);
+	const int64_t remaining_us = not_before_us - esp_timer_get_time();
+	return remaining_us > 0 ? static_cast<uint32_t>((remaining_us + 999) / 1000) : 0;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+enum class UploadFailure : uint8_t {
+	None,
+	Connect,      // the server could not be reached
+	Timeout,      // the connection stalled or dropped mid-request
+	RateLimited,  // 429 Too Many Requests
+	ServerError,  // 5xx: the body was not processed
+	Rejected,     // any other non-2xx status: sending the same body again will not help
+	Deferred,     // not attempted because the server asked for a pause
+};
+
+struct RetryPolicy {
+	uint32_t base_delay_ms;
+	uint32_t max_delay_ms;
+	uint32_t max_attempts;
+};
+
+// Backoff shared by every task that talks to the server, so a node backs off as a whole: the
+// earliest time the next request may start and the run of consecutive failures that set it.
+struct RetryBackoff {
+	portMUX_TYPE lock;
+	int64_t not_before_us;
+	uint32_t consecutive_failures;
+};
+
+UploadFailure upload_failure_classify(esp_err_t err, int http_status);
+const char* upload_failure_name(UploadFailure failure);
+// Connect failures and server-side trouble are worth another attempt; rejected bodies are not.
+bool upload_failure_retryable(UploadFailure failure);
+
+void retry_backoff_init(RetryBackoff* backoff);
+void retry_backoff_success(RetryBackoff* backoff);
+// Capped exponential backoff with equal jitter, never shorter than the server's Retry-After.
+// Returns the delay applied.
+uint32_t retry_backoff_failure(RetryBackoff* backoff, const RetryPolicy* policy, uint32_t retry_after_ms);
+uint32_t retry_backoff_remaining_ms(RetryBackoff* backoff);
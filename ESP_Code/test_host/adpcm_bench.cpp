@@ -0,0 +1,38 @@
+// Encodes rock_dove_bin in DMA-frame-sized chunks, as the uploader does, and reports throughput.
+// With a path argument the encoded stream is written there for roundtrip.py to decode.
+#include <algorithm>
+
+#include "adpcm_encoder.h"
+#include "bench.h"
+
+static constexpr size_t CHUNK_SAMPLES = 512;
+
+static size_t encode(const std::vector<int16_t>& samples, std::vector<uint8_t>* output) {
+	AdpcmEncoder encoder;
+	adpcm_encoder_reset(&encoder);
+	size_t length = 0;
+	for (size_t offset = 0; offset < samples.size(); offset += CHUNK_SAMPLES) {
+		const size_t count = std::min(CHUNK_SAMPLES, samples.size() - offset);
+		length += adpcm_encoder_encode(&encoder, samples.data() + offset, count, output->data() + length);
+	}
+	return length + adpcm_encoder_flush(&encoder, output->data() + length);
+}
+
+int main(int argc, char** argv) {
+	const std::vector<int16_t> samples = load_rock_dove();
+	std::vector<uint8_t> encoded((samples.size() + 1) / 2);
+	const size_t length = encode(samples, &encoded);
+	if (argc > 1 && !write_file(argv[1], encoded.data(), length)) {
+		return 1;
+	}
+
+	const BenchResult result = bench(50, [&] { encode(samples, &encoded); });
+	printf(
+		"adpcm: %zu samples -> %zu bytes, %.2f ns/sample, %.1f host cycles/sample\n",
+		samples.size(),
+		length,
+		result.ns / samples.size(),
+		result.cycles / samples.size()
+	);
+	return 0;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "rock_dove.h"
+
+// rock_dove_bin is mono PCM16 with no rate of its own; the codec benchmarks treat it as audio at
+// the server's analysis rate.
+static constexpr uint32_t ROCK_DOVE_SAMPLE_RATE_HZ = 8000;
+
+// The fixture as samples; the byte array carries no alignment guarantee.
+inline std::vector<int16_t> load_rock_dove() {
+	std::vector<int16_t> samples(rock_dove_bin_len / sizeof(int16_t));
+	memcpy(samples.data(), rock_dove_bin, samples.size() * sizeof(int16_t));
+	return samples;
+}
+
+struct BenchResult {
+	double ns;
+	double cycles;  // host cycles from the TSC, 0 where there is none
+};
+
+// Mean time of one call to run over repeats calls. Host cycles only rank changes against each
+// other; on the ESP32-C3 the same loops take several times as many cycles.
+template <typename Fn>
+BenchResult bench(int repeats, Fn run) {
+	run();
+#if defined(__x86_64__) || defined(__i386__)
+	const uint64_t start_cycles = __rdtsc();
+#endif
+	const auto start = std::chrono::steady_clock::now();
+	for (int repeat = 0; repeat < repeats; ++repeat) {
+		run();
+	}
+	const auto elapsed = std::chrono::steady_clock::now() - start;
+	BenchResult result = {};
+	result.ns = std::chrono::duration<double, std::nano>(elapsed).count() / repeats;
+#if defined(__x86_64__) || defined(__i386__)
+	result.cycles = static_cast<double>(__rdtsc() - start_cycles) / repeats;
+#endif
+	return result;
+}
+
+inline bool write_file(const char* path, const void* data, size_t length) {
+	FILE* file = fopen(path, "wb");
+	if (file == nullptr) {
+		perror(path);
+		return false;
+	}
+	const bool ok = fwrite(data, 1, length, file) == length;
+	fclose(file);
+	return ok;
+}
@@ -0,0 +1,46 @@
+// Runs rock_dove_bin through every decimation ratio and filter in DMA-frame-sized chunks, as the
+// capture task does, and reports the cost per input sample.
+#include <algorithm>
+
+#include "bench.h"
+#include "decimator.h"
+
+static constexpr size_t CHUNK_SAMPLES = 512;
+
+static size_t decimate(Decimator* decimator, const std::vector<int16_t>& samples, std::vector<int16_t>* output) {
+	decimator_reset(decimator);
+	size_t length = 0;
+	for (size_t offset = 0; offset < samples.size(); offset += CHUNK_SAMPLES) {
+		const size_t count = std::min(CHUNK_SAMPLES, samples.size() - offset);
+		length += decimator_process(decimator, samples.data() + offset, count, output->data() + length, output->size() - length);
+	}
+	return length;
+}
+
+int main() {
+	const std::vector<int16_t> samples = load_rock_dove();
+	std::vector<int16_t> output(samples.size());
+	for (size_t factor : {2, 3, 4, 6}) {
+		for (DecimatorFilter filter : {DecimatorFilter::Fast, DecimatorFilter::Sharp}) {
+			Decimator decimator;
+			if (decimator_init(&decimator, factor, filter) != ESP_OK) {
+				fprintf(stderr, "decimator_init failed for ratio %zu\n", factor);
+				return 1;
+			}
+			const size_t length = decimate(&decimator, samples, &output);
+			if (length != samples.size() / factor) {
+				fprintf(stderr, "ratio %zu gave %zu samples from %zu\n", factor, length, samples.size());
+				return 1;
+			}
+			const BenchResult result = bench(20, [&] { decimate(&decimator, samples, &output); });
+			printf(
+				"decimator 1/%zu %s: %.2f ns/sample, %.1f host cycles/sample\n",
+				factor,
+				filter == DecimatorFilter::Sharp ? "sharp" : "fast",
+				result.ns / samples.size(),
+				result.cycles / samples.size()
+			);
+		}
+	}
+	return 0;
+}
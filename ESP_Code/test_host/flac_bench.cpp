@@ -0,0 +1,50 @@
+// Encodes rock_dove_bin as one FLAC stream in DMA-frame-sized writes and reports the compression
+// ratio and encode cost per second of audio. With a path argument the stream is written there for
+// roundtrip.py to decode.
+#include <algorithm>
+
+#include "bench.h"
+#include "flac_encoder.h"
+
+static constexpr size_t CHUNK_SAMPLES = 512;
+
+static esp_err_t append(const uint8_t* data, size_t length, void* user_ctx) {
+	std::vector<uint8_t>* output = static_cast<std::vector<uint8_t>*>(user_ctx);
+	output->insert(output->end(), data, data + length);
+	return ESP_OK;
+}
+
+static esp_err_t encode(FlacEncoder* encoder, const std::vector<int16_t>& samples, std::vector<uint8_t>* output) {
+	output->clear();
+	esp_err_t err = flac_encoder_begin(encoder, ROCK_DOVE_SAMPLE_RATE_HZ, samples.size(), append, output);
+	for (size_t offset = 0; err == ESP_OK && offset < samples.size(); offset += CHUNK_SAMPLES) {
+		const size_t count = std::min(CHUNK_SAMPLES, samples.size() - offset);
+		err = flac_encoder_write(encoder, samples.data() + offset, count, append, output);
+	}
+	return err == ESP_OK ? flac_encoder_finish(encoder, append, output) : err;
+}
+
+int main(int argc, char** argv) {
+	const std::vector<int16_t> samples = load_rock_dove();
+	static FlacEncoder encoder;
+	std::vector<uint8_t> encoded;
+	if (encode(&encoder, samples, &encoded) != ESP_OK) {
+		fprintf(stderr, "flac encode failed\n");
+		return 1;
+	}
+	if (argc > 1 && !write_file(argv[1], encoded.data(), encoded.size())) {
+		return 1;
+	}
+
+	const BenchResult result = bench(20, [&] { encode(&encoder, samples, &encoded); });
+	const double audio_seconds = static_cast<double>(samples.size()) / ROCK_DOVE_SAMPLE_RATE_HZ;
+	printf(
+		"flac: %zu PCM16 bytes -> %zu bytes (%.1f%% of PCM16), %.1f us and %.2f M host cycles per second of audio\n",
+		samples.size() * sizeof(int16_t),
+		encoded.size(),
+		100.0 * encoded.size() / (samples.size() * sizeof(int16_t)),
+		result.ns / 1000.0 / audio_seconds,
+		result.cycles / 1e6 / audio_seconds
+	);
+	return 0;
+}
@@ -0,0 +1,141 @@
+// Runs the activity detector over rock_dove_bin mixed 10 s into synthetic quiet, gusty-wind and
+// traffic backgrounds, comparing the energy and bird-band modes, and reports the bird-band cost.
+// The fixture is played at 16 kHz, then at 8 kHz by averaging sample pairs. Fails if the bird-band
+// detector flags any frame of background alone or misses the dove entirely.
+#include <algorithm>
+#include <math.h>
+#include <random>
+
+#include "activity_detector.h"
+#include "bench.h"
+
+static constexpr uint32_t THRESHOLD_DB = 9;
+static constexpr uint32_t HANGOVER_FRAMES = 15;
+static constexpr size_t FRAME_MS = 20;
+static constexpr size_t CHUNK_SAMPLES = 256;
+static constexpr unsigned NOISE_SEED = 7;
+
+enum class Background {
+	Quiet,
+	Wind,     // low-passed noise under a 0.4 Hz gust envelope
+	Traffic,  // engine harmonics of 60 Hz and tyre hiss, swelling every 8 s
+};
+
+static const char* background_name(Background background) {
+	switch (background) {
+	case Background::Quiet: return "quiet";
+	case Background::Wind: return "wind";
+	case Background::Traffic: return "traffic";
+	}
+	return "";
+}
+
+static std::vector<int16_t> make_background(Background background, size_t sample_count, uint32_t sample_rate) {
+	std::mt19937 random(NOISE_SEED);
+	std::normal_distribution<float> gaussian(0.0f, 1.0f);
+	std::vector<int16_t> samples(sample_count);
+	float low1 = 0.0f;
+	float low2 = 0.0f;
+	for (size_t index = 0; index < sample_count; ++index) {
+		const float t = static_cast<float>(index) / sample_rate;
+		float value = 20.0f * gaussian(random);
+		if (background == Background::Wind) {
+			float gust = 0.5f + 0.5f * sinf(6.283f * 0.4f * t);
+			gust = gust * gust * gust;
+			low1 += 0.05f * (gaussian(random) * 6000.0f - low1);
+			low2 += 0.05f * (low1 - low2);
+			value += gust * low2 * 3.0f + gust * 90.0f * gaussian(random);
+		} else if (background == Background::Traffic) {
+			const float swell = expf(-powf((fmodf(t, 8.0f) - 4.0f) / 1.5f, 2.0f));
+			for (int harmonic = 1; harmonic <= 10; ++harmonic) {
+				value += swell * 1500.0f / harmonic * sinf(6.283f * 60.0f * harmonic * t + harmonic);
+			}
+			low1 += 0.3f * (gaussian(random) - low1);
+			value += swell * 400.0f * low1;
+		}
+		samples[index] = static_cast<int16_t>(std::clamp(value, -32768.0f, 32767.0f));
+	}
+	return samples;
+}
+
+struct FrameCounts {
+	size_t lead_in;
+	size_t dove;
+	size_t tail;
+};
+
+static FrameCounts count_active(ActivityDetector* detector, const std::vector<int16_t>& samples, size_t frame_samples, size_t dove_begin, size_t dove_end) {
+	FrameCounts counts = {};
+	for (size_t offset = 0; offset + frame_samples <= samples.size(); offset += frame_samples) {
+		const size_t active = activity_detector_process(detector, samples.data() + offset, frame_samples, 0);
+		(offset < dove_begin ? counts.lead_in : offset < dove_end ? counts.dove : counts.tail) += active;
+	}
+	return counts;
+}
+
+static bool run(uint32_t sample_rate, const std::vector<int16_t>& dove) {
+	const size_t frame_samples = sample_rate * FRAME_MS / 1000;
+	const size_t padding = 10 * sample_rate;
+	const size_t padding_frames = padding / frame_samples;
+	printf("%u Hz, %zu sample frames, dove %zu frames\n", static_cast<unsigned>(sample_rate), frame_samples, dove.size() / frame_samples);
+	bool passed = true;
+	for (bool bird_bands : {false, true}) {
+		for (Background background : {Background::Quiet, Background::Wind, Background::Traffic}) {
+			const std::vector<int16_t> quiet = make_background(background, padding + dove.size() + padding, sample_rate);
+			std::vector<int16_t> mixed = quiet;
+			for (size_t index = 0; index < dove.size(); ++index) {
+				mixed[padding + index] = static_cast<int16_t>(std::clamp(mixed[padding + index] + dove[index], -32768, 32767));
+			}
+			for (bool with_dove : {false, true}) {
+				ActivityDetector detector;
+				const esp_err_t err = bird_bands ? activity_detector_init_bird_bands(&detector, sample_rate, frame_samples, THRESHOLD_DB, HANGOVER_FRAMES)
+				                                 : activity_detector_init(&detector, frame_samples, THRESHOLD_DB, HANGOVER_FRAMES);
+				if (err != ESP_OK) {
+					fprintf(stderr, "activity detector init failed\n");
+					return false;
+				}
+				const FrameCounts counts = count_active(&detector, with_dove ? mixed : quiet, frame_samples, padding, padding + dove.size());
+				printf(
+					"  %-10s %-8s %-7s active frames: lead-in %3zu/%zu, dove span %3zu, tail %3zu/%zu\n",
+					bird_bands ? "bird-bands" : "energy",
+					background_name(background),
+					with_dove ? "+dove" : "bg only",
+					counts.lead_in,
+					padding_frames,
+					counts.dove,
+					counts.tail,
+					padding_frames
+				);
+				const size_t background_frames = counts.lead_in + counts.tail + (with_dove ? 0 : counts.dove);
+				if (bird_bands && (background_frames > 0 || (with_dove && counts.dove == 0))) {
+					fprintf(stderr, "bird-bands %s: %zu background frames flagged, %zu in the dove span\n", background_name(background), background_frames, counts.dove);
+					passed = false;
+				}
+			}
+		}
+	}
+
+	ActivityDetector detector;
+	activity_detector_init_bird_bands(&detector, sample_rate, frame_samples, THRESHOLD_DB, HANGOVER_FRAMES);
+	const BenchResult result = bench(20, [&] {
+		for (size_t offset = 0; offset + CHUNK_SAMPLES <= dove.size(); offset += CHUNK_SAMPLES) {
+			activity_detector_process(&detector, dove.data() + offset, CHUNK_SAMPLES, 0);
+		}
+	});
+	printf(
+		"  bird-bands: %zu bins, %.2f ns/sample, %.1f host cycles/sample\n",
+		detector.bands.bin_count,
+		result.ns / dove.size(),
+		result.cycles / dove.size()
+	);
+	return passed;
+}
+
+int main() {
+	const std::vector<int16_t> dove = load_rock_dove();
+	std::vector<int16_t> dove_8k(dove.size() / 2);
+	for (size_t index = 0; index < dove_8k.size(); ++index) {
+		dove_8k[index] = static_cast<int16_t>((dove[2 * index] + dove[2 * index + 1]) / 2);
+	}
+	return run(16000, dove) && run(8000, dove_8k) ? 0 : 1;
+}
@@ -0,0 +1,64 @@
+# Decodes the host encoders' output of rock_dove_bin with the API's decoders and checks it against
+# the fixture: ADPCM must keep an SNR good enough for classification and FLAC must be bit exact.
+# Usage: roundtrip.py FIXTURE_HEADER [--adpcm ENCODER] [--flac ENCODER]
+import argparse
+import math
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), "..", "..", "API"))
+from audio_codecs import decode_flac, decode_ima_adpcm  # noqa: E402
+
+import numpy as np  # noqa: E402
+
+# Classification holds up down to about 20 dB; the encoder gives about 30 dB on the fixture.
+MIN_ADPCM_SNR_DB = 25.0
+
+def load_fixture(header_path):
+    with open(header_path) as f:
+        text = f.read()
+    body = text[text.index("{") + 1 : text.index("}")]
+    data = bytes(int(value, 16) for value in re.findall(r"0x[0-9a-fA-F]+", body))
+    return np.frombuffer(data, dtype="<i2")
+
+def run_encoder(encoder):
+    with tempfile.TemporaryDirectory() as directory:
+        path = os.path.join(directory, "encoded")
+        subprocess.run([encoder, path], check=True)
+        with open(path, "rb") as f:
+            return f.read()
+
+def check_adpcm(reference, encoder):
+    decoded = np.frombuffer(decode_ima_adpcm(run_encoder(encoder)), dtype="<i2")[: len(reference)]
+    signal = np.sum(reference.astype(np.float64) ** 2)
+    noise = np.sum((reference.astype(np.float64) - decoded) ** 2)
+    snr_db = 10 * math.log10(signal / noise)
+    print(f"adpcm round trip: {snr_db:.1f} dB SNR")
+    return len(decoded) == len(reference) and snr_db >= MIN_ADPCM_SNR_DB
+
+def check_flac(reference, encoder):
+    decoded = np.frombuffer(decode_flac(run_encoder(encoder)), dtype="<i2")
+    exact = np.array_equal(decoded, reference)
+    print(f"flac round trip: {'bit exact' if exact else 'MISMATCH'}")
+    return exact
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("fixture")
+    parser.add_argument("--adpcm")
+    parser.add_argument("--flac")
+    args = parser.parse_args()
+
+    reference = load_fixture(args.fixture)
+    ok = True
+    if args.adpcm:
+        ok &= check_adpcm(reference, args.adpcm)
+    if args.flac:
+        ok &= check_flac(reference, args.flac)
+    return 0 if ok else 1
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,62 @@
+"""Wrap an int8 .tflite bird classifier for the "model" partition.
+
+The header layout is BirdModelHeader in main/bird_classifier.h. Write the result with
+    parttool.py --port PORT write_partition --partition-name model --input model.bin
+"""
+
+import argparse
+import struct
+import zlib
+
+MAGIC = b"BSMD"
+VERSION = 1
+HEADER = struct.Struct("<4sHHIIIHHHHHBB32x")
+PARTITION_SIZE = 0x40000
+
+
+def pack(model, args):
+    header = HEADER.pack(
+        MAGIC,
+        VERSION,
+        HEADER.size,
+        len(model),
+        zlib.crc32(model),
+        args.sample_rate,
+        args.fft_size,
+        args.hop_samples,
+        args.fmin_hz,
+        args.fmax_hz,
+        args.frames,
+        args.mel_bands,
+        args.bird_class,
+    )
+    return header + model
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("model", help="int8 quantized .tflite")
+    parser.add_argument("output")
+    # Feature settings the model was trained on; they must match the log-mel encoder.
+    parser.add_argument("--sample-rate", type=int, default=8000)
+    parser.add_argument("--fft-size", type=int, default=512)
+    parser.add_argument("--hop-samples", type=int, default=256)
+    parser.add_argument("--fmin-hz", type=int, default=150)
+    parser.add_argument("--fmax-hz", type=int, default=0)
+    parser.add_argument("--frames", type=int, default=32, help="frames per input patch")
+    parser.add_argument("--mel-bands", type=int, default=32)
+    parser.add_argument("--bird-class", type=int, default=1, help="output index of the bird class")
+    args = parser.parse_args()
+
+    with open(args.model, "rb") as f:
+        model = f.read()
+    image = pack(model, args)
+    if len(image) > PARTITION_SIZE:
+        parser.error(f"{len(image)} bytes do not fit the {PARTITION_SIZE} byte partition")
+    with open(args.output, "wb") as f:
+        f.write(image)
+    print(f"{args.output}: {len(model)} byte model, crc {zlib.crc32(model):08x}")
+
+
+if __name__ == "__main__":
+    main()